@@ -0,0 +1,28 @@
+#!/bin/sh
+# Times every script of this directory, keeping the best of several runs.
+# usage: bench/run.sh path/to/brockstar [runs] [interpreter options...]
+
+if [ $# -lt 1 ]; then
+    echo "usage: $0 path/to/brockstar [runs] [interpreter options...]" >&2
+    exit 1
+fi
+
+brockstar=$1
+runs=${2:-5}
+shift
+[ $# -gt 0 ] && shift
+directory=$(dirname "$0")
+
+for script in "$directory"/*.rock; do
+    best=
+    for run in $(seq "$runs"); do
+        start=$(date +%s%N)
+        "$brockstar" "$@" "$script" > /dev/null || exit 1
+        end=$(date +%s%N)
+        elapsed=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then
+            best=$elapsed
+        fi
+    done
+    printf '%-12s %6d ms\n' "$(basename "$script" .rock)" "$best"
+done
@@ -0,0 +1,232 @@
+#include "cache.h"
+#include "scanner.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// the numbering of the token types is saved, Scanner::FormatVersion must change with it
+static_assert(Token::Type::EndOfFile == 56, "the token types changed, bump Scanner::FormatVersion and this count");
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint32_t tokenCount;
+    uint32_t lineCount;
+    uint32_t stringCount;
+    uint32_t stringsSize;
+};
+static_assert(sizeof(Header) == 40, "the header is written as it is, it must not have padding");
+
+constexpr char Magic[4] = { 'R', 'K', 'C', '3' };
+
+uint64_t hashBytes(std::string_view data)
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ data.size();
+
+    size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data.data() + i, 8);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+
+    for (; i < data.size(); i++)
+    {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 0xC4CEB9FE1A85EC53ull;
+    }
+
+    return hash ^ (hash >> 29);
+}
+
+std::string cacheDirectory()
+{
+    if (auto xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+    {
+        return fmt::format("{}/brockstar", xdg);
+    }
+
+    if (auto home = std::getenv("HOME"); home && *home)
+    {
+        return fmt::format("{}/.cache/brockstar", home);
+    }
+
+    return {};
+}
+
+}
+
+TokenCache::TokenCache(std::string_view source)
+    : hash { hashBytes(source) }, size { source.size() }
+{
+    auto directory = cacheDirectory();
+    if (directory.size())
+    {
+        path = fmt::format("{}/{:016x}.rockc", directory, hash);
+    }
+}
+
+bool TokenCache::load(TokenStore & program)
+{
+    if (path.empty())
+    {
+        return false;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    void * data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header))
+    {
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    size_t fileSize = st.st_size;
+    std::shared_ptr<const char> file(static_cast<const char *>(data), [fileSize](const char * bytes) {
+        munmap(const_cast<char *>(bytes), fileSize);
+    });
+
+    Header header;
+    std::memcpy(&header, file.get(), sizeof(header));
+
+    // values, source lines, line starts and string ends, then types and the
+    // strings, the 32 bits arrays are aligned since the header is
+    uint64_t tokens = header.tokenCount;
+    uint64_t lines = header.lineCount;
+    uint64_t expected = sizeof(Header) + 4 * (2 * tokens + lines + 1 + header.stringCount) + tokens + header.stringsSize;
+
+    if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+        || header.version != Scanner::FormatVersion
+        || header.sourceHash != hash
+        || header.sourceSize != size
+        || fileSize != expected)
+    {
+        return false;
+    }
+
+    TokenStore::Mapped mapped;
+    auto cursor = file.get() + sizeof(Header);
+    auto view = [&cursor](auto & array, size_t count) {
+        using Element = typename std::remove_reference_t<decltype(array)>::element_type;
+        array = { reinterpret_cast<Element *>(cursor), count };
+        cursor += count * sizeof(Element);
+    };
+
+    view(mapped.values, tokens);
+    view(mapped.sourceLines, tokens);
+    view(mapped.lineStarts, lines + 1);
+    view(mapped.stringEnds, header.stringCount);
+    view(mapped.types, tokens);
+    mapped.strings = cursor;
+
+    // read without being copied, but a damaged file mustn't be read out of bounds
+    bool valid = mapped.lineStarts.front() == 0 && mapped.lineStarts.back() == tokens
+            && std::is_sorted(mapped.lineStarts.begin(), mapped.lineStarts.end())
+            && std::is_sorted(mapped.stringEnds.begin(), mapped.stringEnds.end())
+            && (mapped.stringEnds.empty() ? header.stringsSize == 0 : mapped.stringEnds.back() == header.stringsSize)
+            && std::all_of(mapped.types.begin(), mapped.types.end(), [](auto type) { return type <= Token::Type::EndOfFile; })
+            && std::all_of(mapped.values.begin(), mapped.values.end(), [&header](auto value) { return value < header.stringCount; });
+
+    if (valid)
+    {
+        program.clear();
+        mapped.file = std::move(file);
+        program.mapped = mapped;
+    }
+
+    return valid;
+}
+
+void TokenCache::save(const TokenStore & program)
+{
+    if (path.empty())
+    {
+        return;
+    }
+
+    std::vector<uint32_t> stringEnds;
+    stringEnds.reserve(program.stringCount());
+    uint64_t stringsSize = 0;
+    for (uint32_t id = 0; id < program.stringCount(); id++)
+    {
+        stringsSize += program.text(id).size();
+        stringEnds.push_back(stringsSize);
+    }
+
+    if (stringsSize > UINT32_MAX || program.tokenCount() > UINT32_MAX)
+    {
+        return;
+    }
+
+    Header header {};
+    std::memcpy(header.magic, Magic, sizeof(Magic));
+    header.version = Scanner::FormatVersion;
+    header.sourceHash = hash;
+    header.sourceSize = size;
+    header.tokenCount = program.tokenCount();
+    header.lineCount = program.size();
+    header.stringCount = program.stringCount();
+    header.stringsSize = stringsSize;
+
+    auto directory = path.substr(0, path.rfind('/'));
+    mkdir(directory.substr(0, directory.rfind('/')).c_str(), 0755);
+    mkdir(directory.c_str(), 0755);
+
+    // written aside then renamed, so concurrent runs never see half a file
+    auto temporary = fmt::format("{}.{}.tmp", path, getpid());
+    auto file = std::fopen(temporary.c_str(), "wb");
+    if (!file)
+    {
+        return;
+    }
+
+    auto write = [file](const auto & array) {
+        return std::fwrite(array.data(), sizeof(array[0]), array.size(), file) == array.size();
+    };
+
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1
+            && write(program.valueArray())
+            && write(program.sourceLineArray())
+            && write(program.lineStartArray())
+            && write(stringEnds)
+            && write(program.typeArray());
+
+    for (uint32_t id = 0; id < program.stringCount(); id++)
+    {
+        auto string = program.text(id);
+        written = written && std::fwrite(string.data(), 1, string.size(), file) == string.size();
+    }
+
+    if (std::fclose(file) == 0 && written)
+    {
+        std::rename(temporary.c_str(), path.c_str());
+    }
+    else
+    {
+        std::remove(temporary.c_str());
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "tokenstore.h"
+
+// tokenized scripts saved under $XDG_CACHE_HOME/brockstar, keyed by the
+// content of the script and the format of the scanner's tokens
+class TokenCache
+{
+public:
+    explicit TokenCache(std::string_view source);
+
+    // makes an empty store read the lines of the script from the cache file
+    // in place, the file staying mapped as long as the store uses it
+    bool load(TokenStore & program);
+    void save(const TokenStore & program);
+
+private:
+    std::string path;
+    uint64_t hash;
+    uint64_t size;
+};
+
+#endif // CACHE_H
@@ -0,0 +1,1253 @@
+#include "compiler.h"
+#include "grammar.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <fmt/format.h>
+#include "value.h"
+
+#define C(c) case Token::Type::c
+
+// what the generated code needs besides Value, Output and Input, failing
+// with the interpreter's messages
+static const char * prelude = R"(#include "value.h"
+#include "error.h"
+#include "output.h"
+#include "input.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+static Value mysterious { Value::Special::Undefined };
+
+[[maybe_unused]] static Value negated(const Value & value)
+{
+    return Value(!value.asBool());
+}
+
+[[maybe_unused]] static void step(Value & variable, int count, const char * verb, int line)
+{
+    if (variable.isDouble())
+    {
+        variable = Value(variable.asDouble() + count);
+    }
+    else if (variable.isBool())
+    {
+        if (count % 2)
+        {
+            variable = Value(!variable.asBool());
+        }
+    }
+    else
+    {
+        std::cerr << "You can't " << verb << " a variable that is not a number or a boolean, on line " << line << '\n';
+        std::exit(1);
+    }
+}
+
+[[maybe_unused]] static void checkIndex(const Value & index, int line)
+{
+    if (!index.isDouble())
+    {
+        std::cerr << "Unexpected value " << index << ", expecting an number after 'at' on line " << line << '\n';
+        std::exit(1);
+    }
+
+    if (static_cast<int>(index.asDouble()) < 0)
+    {
+        std::cerr << "Invalid index " << static_cast<int>(index.asDouble()) << ", expecting an positive number after 'at' on line " << line << '\n';
+        std::exit(1);
+    }
+}
+
+[[maybe_unused]] static Value at(const Value & variable, const Value & index, int line)
+{
+    if (!index.isDouble())
+    {
+        std::cerr << "An array can only be indexed with numbers, on line " << line << '\n';
+        std::exit(1);
+    }
+
+    return variable.getIndex(static_cast<int>(index.asDouble()));
+}
+
+[[maybe_unused]] static void setAt(Value & variable, const Value & index, Value value)
+{
+    if (!variable.isArray())
+    {
+        variable = Value(Value::Special::Array);
+    }
+    variable.setIndex(static_cast<int>(index.asDouble()), std::move(value));
+}
+
+[[maybe_unused]] static void rock(Value & variable)
+{
+    if (!variable.isArray())
+    {
+        variable = Value(Value::Special::Array);
+    }
+}
+
+[[maybe_unused]] static Value roll(Value & variable, int line)
+{
+    if (!variable.isArray())
+    {
+        std::cerr << "Can't roll from a " << variable.type() << ", only from an array on line " << line << '\n';
+        std::exit(1);
+    }
+
+    return variable.pop();
+}
+
+[[maybe_unused]] static void turn(Value & variable, bool up, int line)
+{
+    if (!variable.isDouble())
+    {
+        std::cerr << "You can 'turn " << (up ? "up" : "down") << "' only a number, got a " << variable.type() << ", on line " << line << '\n';
+        std::exit(1);
+    }
+
+    variable = Value(up ? std::ceil(variable.asDouble()) : std::floor(variable.asDouble()));
+}
+
+[[maybe_unused]] static Value listen()
+{
+    auto line = Input::standard().readLine();
+    return line ? Value(std::string(*line)) : Value(Value::Special::Undefined);
+}
+)";
+
+Compiler::Compiler(TokenStore program)
+    : program { std::move(program) }
+{
+    this->program.addEndOfFile();
+
+    findFunctions();
+}
+
+void Compiler::emit(std::ostream & out)
+{
+    std::vector<std::ostringstream> bodies(functions.size());
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        function = &functions[i];
+        code = &bodies[i];
+        translate(function->firstLine, function->endLine);
+    }
+
+    std::ostringstream script;
+    function = nullptr;
+    code = &script;
+    translate(0, program.size());
+
+    // the locals start as the script's variable of the same name
+    std::vector<std::vector<std::string>> locals(functions.size());
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        for (const auto & name : functions[i].locals)
+        {
+            if (std::find(functions[i].parameters.begin(), functions[i].parameters.end(), name) == functions[i].parameters.end())
+            {
+                locals[i].push_back(name);
+            }
+        }
+        std::sort(locals[i].begin(), locals[i].end());
+
+        for (const auto & name : locals[i])
+        {
+            variableId(name);
+        }
+        for (const auto & name : functions[i].parameters)
+        {
+            variableId(name);
+        }
+    }
+
+    auto signature = [&](size_t i) {
+        std::string result = "static Value f" + std::to_string(i) + "(";
+        const auto & parameters = functions[i].parameters;
+        for (size_t p = 0; p < parameters.size(); p++)
+        {
+            result += (p ? ", Value l" : "Value l") + std::to_string(variableId(parameters[p]));
+        }
+        return result + ")";
+    };
+
+    out << "// generated by rockstar --emit-cpp, build with\n"
+        << "// g++ -std=c++20 -O2 -I<rockstar> out.cpp <rockstar>/value.cpp <rockstar>/output.cpp <rockstar>/input.cpp -lfmt\n\n"
+        << prelude << '\n';
+
+    for (size_t i = 0; i < variableNames.size(); i++)
+    {
+        out << "static Value g" << i << " { Value::Special::Undefined }; // " << variableNames[i] << '\n';
+    }
+    out << '\n';
+
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        out << signature(i) << "; // " << functions[i].name << '\n';
+    }
+    out << '\n';
+
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        out << signature(i) << "\n{\n";
+        for (const auto & name : locals[i])
+        {
+            auto id = variableId(name);
+            out << "    Value l" << id << " = g" << id << ";\n";
+        }
+        out << "    [[maybe_unused]] Value * it = &mysterious;\n"
+            << bodies[i].str()
+            << "    return Value();\n}\n\n";
+    }
+
+    out << "static int script()\n{\n"
+        << "    [[maybe_unused]] Value * it = &mysterious;\n"
+        << script.str()
+        << "    return 0;\n}\n\n";
+
+    out << "int main()\n{\n"
+        << "    try\n    {\n"
+        << "        return script();\n"
+        << "    }\n"
+        << "    catch (const ScriptError & error)\n    {\n"
+        << "        std::cerr << error.what();\n"
+        << "        return 1;\n"
+        << "    }\n}\n";
+}
+
+void Compiler::findFunctions()
+{
+    for (size_t i = 0; i < program.size(); i++)
+    {
+        tokens = program.getLine(i);
+        line = i;
+        if (!isFunctionDeclaration(tokens))
+        {
+            for (size_t t = 0; t < tokens.size(); t++)
+            {
+                if (isWritten(tokens, t))
+                {
+                    scriptVariables.emplace(tokens[t].value);
+                }
+            }
+            continue;
+        }
+
+        Declaration declaration;
+        declaration.name = tokens[0].value;
+
+        pc = 2;
+        if (tokens[pc].type != Token::Type::Variable)
+        {
+            fail("Unexpected token " + describe(tokens[pc]) + ", expecting a variable since a function requires at least one parameter");
+        }
+        declaration.parameters.emplace_back(tokens[pc++].value);
+
+        while (pc < tokens.size())
+        {
+            auto tok = tokens[pc++];
+            if (tok.type != Token::Type::Comma && tok.type != Token::Type::And)
+            {
+                fail("Unexpected token " + describe(tok));
+            }
+
+            tok = tokens[pc++];
+            if (tok.type != Token::Type::Variable)
+            {
+                fail("Unexpected token " + describe(tok) + ", function expects variable as parameters");
+            }
+            declaration.parameters.emplace_back(tok.value);
+        }
+
+        if (functionIds.contains(declaration.name))
+        {
+            fail("Can't compile '" + declaration.name + "' being declared twice");
+        }
+
+        declaration.firstLine = i + 1;
+        auto end = bodyEnd(program, declaration.firstLine);
+        for (auto l = declaration.firstLine; l < end; l++)
+        {
+            if (isFunctionDeclaration(program.getLine(l)))
+            {
+                tokens = program.getLine(l);
+                fail("Can't compile a function declared inside a function");
+            }
+        }
+        declaration.endLine = end;
+
+        findLocals(declaration);
+
+        functionIds[declaration.name] = functions.size();
+        declarationLines[i] = functions.size();
+        functions.push_back(std::move(declaration));
+
+        // the closing line is looked at again, a function can't start there
+        i = end - 1;
+    }
+}
+
+void Compiler::findLocals(Declaration & declaration)
+{
+    declaration.locals.insert(declaration.parameters.begin(), declaration.parameters.end());
+
+    for (auto l = declaration.firstLine; l < declaration.endLine; l++)
+    {
+        auto body = program.getLine(l);
+        for (size_t i = 0; i < body.size(); i++)
+        {
+            if (isWritten(body, i))
+            {
+                declaration.locals.emplace(body[i].value);
+            }
+        }
+    }
+}
+
+void Compiler::translate(size_t from, size_t to)
+{
+    blocks.clear();
+    indent = 1;
+
+    for (line = from; line < to; line++)
+    {
+        if (!function && declarationLines.contains(line))
+        {
+            // the body is translated on its own, its closing line may still close a block
+            line = functions[declarationLines[line]].endLine - 1;
+            continue;
+        }
+
+        tokens = program.getLine(line);
+        pc = 1;
+        statement();
+
+        if (pc + 1 < tokens.size())
+        {
+            fail("Not everything has been eaten");
+        }
+    }
+
+    while (blocks.size())
+    {
+        closeBlock();
+    }
+}
+
+void Compiler::statement()
+{
+    auto tok = tokens.front();
+    if (isTakeItToTheTop(tokens))
+    {
+        tok.type = Token::Type::Continue;
+    }
+
+    switch (tok.type)
+    {
+    C(Variable):
+        parseVariable(tok.value);
+        break;
+    C(NewLine):
+        if (blocks.size())
+        {
+            closeBlock();
+        }
+        break;
+    C(EndOfFile):
+        while (blocks.size())
+        {
+            closeBlock();
+        }
+        break;
+    C(Shout):
+    {
+        auto value = expression();
+        out() << "Output::standard() << " << value << " << '\\n';\n";
+        break;
+    }
+    C(Let):
+        let();
+        break;
+    C(Put):
+        put();
+        break;
+    C(Build):
+    C(Knock):
+        step(tok.type);
+        break;
+    C(Give):
+    {
+        if (tokens[pc].type == Token::Type::Back)
+        {
+            pc++;
+        }
+
+        auto value = expression();
+        if (function)
+        {
+            out() << "return " << value << ";\n";
+        }
+        else
+        {
+            out() << "return 0;\n";
+        }
+        break;
+    }
+    C(Rock):
+        rock();
+        break;
+    C(Roll):
+    {
+        auto value = roll();
+
+        if (tokens[pc].type == Token::Type::Into)
+        {
+            auto target = tokens[++pc];
+            if (target.type != Token::Type::Variable)
+            {
+                fail("Unexpected token " + describe(target) + ", expecting a variable after 'into'");
+            }
+
+            out() << storage(target.value) << " = " << value << ";\n";
+            pc++;
+        }
+        break;
+    }
+    C(Turn):
+        turn();
+        break;
+    C(Listen):
+        listen();
+        break;
+    C(If):
+    {
+        auto condition = expression();
+        out() << "if (" << condition << ".asBool())\n";
+        out() << "{\n";
+        indent++;
+        blocks.push_back(tok.type);
+        break;
+    }
+    C(Else):
+    {
+        if (blocks.empty() || blocks.back() != Token::Type::If)
+        {
+            fail("Can't compile an 'else' outside of an 'if'");
+        }
+
+        indent--;
+        out() << "}\n";
+        out() << "else\n";
+        out() << "{\n";
+        indent++;
+        blocks.back() = tok.type;
+        break;
+    }
+    C(While):
+    C(Until):
+        loop(tok.type);
+        break;
+    C(Break):
+    C(Continue):
+    {
+        if (tok.type == Token::Type::Break && tokens[pc].type == Token::Type::Pronoun && tokens[pc + 1].type == Token::Type::Down)
+        {
+            pc += 2;
+        }
+        else if (tok.type == Token::Type::Continue && tokens[pc].type == Token::Type::Pronoun
+                 && tokens[pc + 1].value == "to" && tokens[pc + 2].value == "the top")
+        {
+            pc += 3;
+        }
+
+        if (std::find_if(blocks.begin(), blocks.end(), [](auto type) { return type == Token::Type::While || type == Token::Type::Until; }) == blocks.end())
+        {
+            fail("'" + std::string(tok.value) + "' outside of a loop");
+        }
+
+        out() << (tok.type == Token::Type::Break ? "break;\n" : "continue;\n");
+        break;
+    }
+    default:
+        fail("Unexpected token " + describe(tok));
+    }
+}
+
+void Compiler::closeBlock()
+{
+    indent--;
+    out() << "}\n";
+    blocks.pop_back();
+}
+
+void Compiler::fail(const std::string & message)
+{
+    std::cerr << message << " on line " << tokens.front().line << '\n';
+    std::exit(1);
+}
+
+void Compiler::parseVariable(std::string_view name)
+{
+    auto tok = tokens[pc++];
+
+    switch (tok.type)
+    {
+    C(Is):
+    {
+        setPronoun(name);
+
+        auto value = tokens[pc++];
+        switch (value.type)
+        {
+        C(Number):
+        C(True):
+        C(False):
+        C(Mysterious):
+        C(String):
+            out() << storage(name) << " = " << literal(value) << ";\n";
+            break;
+        C(Null):
+            out() << storage(name) << " = Value(0.0);\n";
+            break;
+        default:
+            fail("Unexpected token " + describe(value) + " after 'is'");
+        }
+        break;
+    }
+    C(Says):
+    {
+        setPronoun(name);
+
+        auto value = tokens[pc++];
+        if (value.type != Token::Type::String)
+        {
+            fail("Unexpected token " + describe(value) + " after 'says'");
+        }
+        out() << storage(name) << " = " << literal(value) << ";\n";
+        break;
+    }
+    C(Taking):
+        call(name);
+        break;
+    default:
+        fail("Unexpected token " + describe(tok) + " after variable");
+    }
+}
+
+void Compiler::let()
+{
+    auto variableIndex = pc;
+    auto tok = tokens[pc++];
+
+    if (tok.type != Token::Type::Variable)
+    {
+        fail("Unexpected token " + describe(tok) + ", expecting a variable after 'let'");
+    }
+
+    std::string name(tok.value);
+    setPronoun(name);
+
+    std::string index;
+    if (tokens[pc].type == Token::Type::At)
+    {
+        // the interpreter sets the element of the innermost scope having the variable
+        requireSet(name, "setting an element of");
+        pc++;
+        index = expression();
+        out() << "checkIndex(" << index << ", " << tok.line << ");\n";
+    }
+
+    auto assign = [&](const std::string & value) {
+        if (index.size())
+        {
+            out() << "setAt(" << storage(name) << ", " << index << ", " << value << ");\n";
+        }
+        else
+        {
+            out() << storage(name) << " = " << value << ";\n";
+        }
+    };
+
+    if (tokens[pc++].type != Token::Type::Be)
+    {
+        fail("Unexpected token " + describe(tok) + ", expecting 'be' after the variable");
+    }
+
+    if (tokens.size() > pc + 3 && (tokens[pc + 2].type == Token::Type::Comma || tokens[pc + 3].type == Token::Type::Comma))
+    {
+        auto initialValue = variableIndex;
+        auto op = tokens[pc];
+        bool hasValue = false;
+        if (tokens[pc + 3].type == Token::Type::Comma)
+        {
+            initialValue = pc;
+            op = tokens[pc + 1];
+            hasValue = true;
+        }
+
+        pc += (hasValue ? 2 : 1);
+
+        const char * symbol = nullptr;
+        switch (op.type)
+        {
+        C(Plus): symbol = " + "; break;
+        C(Minus): symbol = " - "; break;
+        C(Times): symbol = " * "; break;
+        C(Over): symbol = " / "; break;
+        default:
+            fail("Unexpected token " + describe(op) + ", expecting an arithmetic operator");
+        }
+
+        auto values = list();
+        auto result = operand(tokens[initialValue]);
+        for (const auto & value : values)
+        {
+            result = "(" + result + symbol + value + ")";
+        }
+
+        assign(result);
+    }
+    else
+    {
+        assign(expression(true, name));
+    }
+}
+
+void Compiler::put()
+{
+    auto tok = tokens[pc];
+
+    if (tok.type != Token::Type::Number && tok.type != Token::Type::Variable && tok.type != Token::Type::String)
+    {
+        fail("Unexpected token " + describe(tok) + " after 'put'");
+    }
+
+    auto value = expression();
+
+    tok = tokens[pc++];
+    if (tok.type != Token::Type::Into)
+    {
+        fail("Unexpected token " + describe(tok) + ", expecting 'into' after the expression");
+    }
+
+    auto target = tokens[pc++];
+    if (target.type != Token::Type::Variable)
+    {
+        fail("Unexpected token " + describe(tok) + ", expecting a variable after 'into'");
+    }
+
+    out() << storage(target.value) << " = " << value << ";\n";
+    setPronoun(target.value);
+}
+
+void Compiler::step(Token::Type direction)
+{
+    bool up = direction == Token::Type::Build;
+    auto tok = tokens[pc++];
+
+    if (tok.type != Token::Type::Variable && (!up || tok.type != Token::Type::Pronoun))
+    {
+        fail("Unexpected token " + describe(tok) + ", expecting a variable after '" + (up ? "build" : "knock") + "'");
+    }
+
+    if (up && tok.type == Token::Type::Variable)
+    {
+        requireSet(tok.value, "building up");
+    }
+    auto place = tok.type == Token::Type::Pronoun ? std::string("(*it)") : storage(tok.value);
+
+    int count = 0;
+    do {
+        tok = tokens[pc++];
+        bool isComma = tok.type == Token::Type::Comma;
+        if (tok.type != (up ? Token::Type::Up : Token::Type::Down) && !isComma)
+        {
+            fail("Unexpected token " + describe(tok) + ", expecting '" + (up ? "up" : "down") + "' after a variable or others '" + (up ? "up" : "down") + "'");
+        }
+
+        if (!isComma)
+        {
+            count++;
+        }
+    } while (pc < tokens.size());
+
+    out() << "step(" << place << ", " << (up ? count : -count) << ", \"" << (up ? "increment" : "decrement") << "\", " << tok.line << ");\n";
+
+    pc--;
+}
+
+void Compiler::rock()
+{
+    auto tok = tokens[pc++];
+
+    if (tok.type != Token::Type::Variable)
+    {
+        fail("Unexpected token " + describe(tok) + ", expecting a variable after 'rock'");
+    }
+
+    requireSet(tok.value, "rocking");
+    setPronoun(tok.value);
+    auto place = storage(tok.value);
+    out() << "rock(" << place << ");\n";
+
+    if (tokens[pc].type == Token::Type::Plus)
+    {
+        pc++;
+        for (const auto & value : list())
+        {
+            out() << place << ".push(" << value << ");\n";
+        }
+    }
+    else if (tokens[pc].type == Token::Type::Like)
+    {
+        tok = tokens[++pc];
+        if (tok.type != Token::Type::Number)
+        {
+            fail("Unexpected token " + describe(tok) + ", expecting a number after 'like'");
+        }
+        out() << place << ".push(" << literal(tok) << ");\n";
+        pc++;
+    }
+}
+
+std::string Compiler::roll()
+{
+    auto tok = tokens[pc++];
+
+    if (tok.type != Token::Type::Variable)
+    {
+        fail("Unexpected token " + describe(tok) + ", expecting a variable after 'roll'");
+    }
+
+    requireSet(tok.value, "rolling");
+    setPronoun(tok.value);
+    return temporary("roll(" + storage(tok.value) + ", " + std::to_string(tok.line) + ")");
+}
+
+void Compiler::turn()
+{
+    auto op = tokens[pc++];
+
+    if (op.type != Token::Type::Up && op.type != Token::Type::Down)
+    {
+        fail("Unexpected token " + describe(op) + ", expecting 'up' or 'down' after 'turn'");
+    }
+
+    auto tok = tokens[pc++];
+    if (tok.type != Token::Type::Variable)
+    {
+        fail("Unexpected token " + describe(tok) + ", expecting a variable after 'turn " + std::string(op.value) + "'");
+    }
+
+    requireSet(tok.value, "turning");
+    setPronoun(tok.value);
+    out() << "turn(" << storage(tok.value) << ", " << (op.type == Token::Type::Up ? "true" : "false") << ", " << tok.line << ");\n";
+}
+
+void Compiler::listen()
+{
+    if (pc >= tokens.size())
+    {
+        // a bare "listen" discards the line
+        out() << "listen();\n";
+        return;
+    }
+
+    auto tok = tokens[pc++];
+    if (tok.type != Token::Type::Variable || tok.value != "to")
+    {
+        fail("Unexpected token " + describe(tok) + ", expecting 'to' after 'listen'");
+    }
+
+    tok = tokens[pc++];
+    if (tok.type != Token::Type::Variable)
+    {
+        fail("Unexpected token " + describe(tok) + ", expecting a variable after 'listen to'");
+    }
+
+    out() << storage(tok.value) << " = listen();\n";
+    setPronoun(tok.value);
+}
+
+void Compiler::loop(Token::Type type)
+{
+    out() << "while (true)\n";
+    out() << "{\n";
+    indent++;
+
+    auto condition = expression();
+    out() << "if (" << (type == Token::Type::While ? "!" : "") << condition << ".asBool())\n";
+    indent++;
+    out() << "break;\n";
+    indent--;
+
+    blocks.push_back(type);
+}
+
+// the same grammar as Evaluator::evaluateExpression, leaving pc on the
+// first token it didn't use
+std::string Compiler::expression(bool greedy, std::string_view variable)
+{
+    std::vector<Term> terms;
+    std::vector<Token::Type> operators;
+
+    auto implicitVariable = [&]() {
+        if (terms.empty() && variable.size())
+        {
+            terms.push_back({ Token::Type::EndOfFile, read(variable), std::string(variable), storage(variable) });
+        }
+    };
+
+    while (pc < tokens.size() && isExpressionToken(tokens[pc].type, greedy))
+    {
+        auto current = tokens[pc];
+
+        switch (current.type)
+        {
+        C(String):
+        C(Number):
+        C(True):
+        C(False):
+        C(Null):
+        C(Mysterious):
+            terms.push_back({ Token::Type::EndOfFile, literal(current), {}, {} });
+            pc++;
+            break;
+        C(Variable):
+            terms.push_back({ Token::Type::EndOfFile, read(current.value), std::string(current.value), storage(current.value) });
+            pc++;
+            break;
+        C(Pronoun):
+        {
+            // the pronoun may name another variable by the time the value is used
+            auto pointer = "t" + std::to_string(temporaries++);
+            out() << "Value * " << pointer << " = it;\n";
+            terms.push_back({ Token::Type::EndOfFile, "(*" + pointer + ")", {}, "(*" + pointer + ")" });
+            pc++;
+            break;
+        }
+        C(Not):
+            terms.push_back({ current.type, {}, {}, {} });
+            pc++;
+            break;
+        C(Plus):
+        C(Minus):
+            implicitVariable();
+            while (operators.size())
+            {
+                terms.push_back({ operators.back(), {}, {}, {} });
+                operators.pop_back();
+            }
+            operators.push_back(current.type);
+            pc++;
+            break;
+        C(Times):
+        C(Over):
+            implicitVariable();
+            operators.push_back(current.type);
+            pc++;
+            break;
+        C(Taking):
+        {
+            if (terms.empty() || terms.back().variable.empty())
+            {
+                fail("Can't compile 'taking' without a function name before it");
+            }
+
+            auto name = terms.back().variable;
+            pc++;
+            terms.back() = { Token::Type::EndOfFile, call(name), {}, {} };
+            break;
+        }
+        C(At):
+        {
+            if (terms.empty() || terms.back().place.empty())
+            {
+                fail("Unexpected 'at'");
+            }
+
+            if (terms.back().variable.size())
+            {
+                requireSet(terms.back().variable, "indexing");
+            }
+            auto place = terms.back().place;
+            pc++;
+            auto index = expression();
+            terms.back() = { Token::Type::EndOfFile, temporary("at(" + place + ", " + index + ", " + std::to_string(current.line) + ")"), {}, {} };
+            break;
+        }
+        C(Roll):
+        {
+            // rolling renames the pronoun, read the variables it named until now
+            for (auto & term : terms)
+            {
+                if (term.op == Token::Type::EndOfFile && term.variable.empty() && term.place.size())
+                {
+                    term = { Token::Type::EndOfFile, temporary(term.code), {}, {} };
+                }
+            }
+
+            pc++;
+            terms.push_back({ Token::Type::EndOfFile, roll(), {}, {} });
+            break;
+        }
+        C(Is):
+        C(Isnt):
+        {
+            bool negate = current.type == Token::Type::Isnt;
+            auto left = combine(terms, operators);
+
+            std::string op = " == ";
+            pc++;
+            switch (tokens[pc].type)
+            {
+            C(As):
+            {
+                auto size = tokens[++pc];
+                if (size.type == Token::Type::Great) op = " >= ";
+                else if (size.type == Token::Type::Little) op = " <= ";
+                else fail("Unexpected token " + describe(size) + " after 'as'");
+
+                if (tokens[++pc].type != Token::Type::As)
+                {
+                    fail("Unexpected token " + describe(tokens[pc]) + ", expecting 'as' after '" + std::string(size.value) + "'");
+                }
+                pc++;
+                break;
+            }
+            C(Not):
+                op = " != ";
+                pc++;
+                break;
+            C(Greater):
+            C(Lower):
+                op = tokens[pc].type == Token::Type::Greater ? " > " : " < ";
+                if (tokens[++pc].type != Token::Type::Than)
+                {
+                    fail("Unexpected token " + describe(tokens[pc]) + ", expecting 'than'");
+                }
+                pc++;
+                break;
+            default:
+                break;
+            }
+
+            auto right = operand(tokens[pc++]);
+            terms.push_back({ Token::Type::EndOfFile, temporary("Value(" + std::string(negate ? "!" : "") + "(" + left + op + right + "))"), {}, {} });
+            break;
+        }
+        C(And):
+        C(Or):
+        {
+            auto left = combine(terms, operators);
+            auto decided = "t" + std::to_string(temporaries++);
+            out() << "bool " << decided << " = " << left << ".asBool();\n";
+            out() << "if (" << (current.type == Token::Type::And ? "" : "!") << decided << ")\n";
+            out() << "{\n";
+            indent++;
+
+            pc++;
+            auto right = expression();
+            out() << decided << " = " << right << ".asBool();\n";
+
+            indent--;
+            out() << "}\n";
+            terms.push_back({ Token::Type::EndOfFile, "Value(" + decided + ")", {}, {} });
+            break;
+        }
+        default:
+            fail("Unexpected token " + describe(current) + " in expression");
+        }
+    }
+
+    return combine(terms, operators);
+}
+
+std::vector<std::string> Compiler::list()
+{
+    std::vector<std::string> values;
+
+    auto tok = tokens[pc];
+    do
+    {
+        if (tokens[pc].type == Token::Type::And)
+        {
+            pc++;
+        }
+        values.push_back(expression());
+
+        tok = tokens[pc++];
+    } while (tok.type == Token::Type::Comma);
+    pc--;
+
+    return values;
+}
+
+std::string Compiler::call(std::string_view name)
+{
+    auto it = functionIds.find(std::string(name));
+    if (it == functionIds.end())
+    {
+        fail("Trying to get a non-existing function called '" + std::string(name) + "'");
+    }
+
+    const auto & parameters = functions[it->second].parameters;
+    std::string code = "f" + std::to_string(it->second) + "(";
+    for (size_t i = 0; i < parameters.size(); i++)
+    {
+        code += (i ? ", " : "") + expression(false);
+
+        if (tokens[pc].type == Token::Type::Comma)
+        {
+            pc++;
+        }
+        else if (i + 1 < parameters.size())
+        {
+            fail("Expecting " + std::to_string(parameters.size()) + " arguments for '" + std::string(name) + "'");
+        }
+    }
+
+    return temporary(code + ")");
+}
+
+std::string Compiler::combine(std::vector<Term> & terms, std::vector<Token::Type> & operators)
+{
+    while (operators.size())
+    {
+        terms.push_back({ operators.back(), {}, {}, {} });
+        operators.pop_back();
+    }
+
+    bool nextIsNegated = false;
+    std::vector<std::string> values;
+    for (const auto & term : terms)
+    {
+        switch (term.op)
+        {
+        C(EndOfFile):
+            values.push_back(term.code);
+            break;
+        C(Not):
+            nextIsNegated = !nextIsNegated;
+            break;
+        C(Plus):
+        C(Minus):
+        C(Times):
+        C(Over):
+        {
+            if (values.size() < 2)
+            {
+                fail("Invalid expression");
+            }
+
+            auto r = std::move(values.back()); values.pop_back();
+            auto l = std::move(values.back()); values.pop_back();
+            const char * symbol = term.op == Token::Type::Plus ? " + " : term.op == Token::Type::Minus ? " - " : term.op == Token::Type::Times ? " * " : " / ";
+            values.push_back("(" + l + symbol + r + ")");
+            break;
+        }
+        default:
+            fail("Invalid expression");
+        }
+
+        if (nextIsNegated && term.op != Token::Type::Not)
+        {
+            values.back() = "negated(" + values.back() + ")";
+            nextIsNegated = false;
+        }
+    }
+
+    if (values.size() != 1)
+    {
+        fail("Invalid expression");
+    }
+
+    terms.clear();
+
+    // a lone call, comparison... is already held by a temporary
+    const auto & value = values.back();
+    if (value[0] == 't' && value.find_first_not_of("0123456789", 1) == std::string::npos)
+    {
+        return value;
+    }
+
+    return temporary(value);
+}
+
+std::string Compiler::operand(const TokenRef & tok)
+{
+    switch (tok.type)
+    {
+    C(Variable):
+        return read(tok.value);
+    C(Pronoun):
+        return "(*it)";
+    default:
+        return literal(tok);
+    }
+}
+
+std::string Compiler::literal(const TokenRef & tok)
+{
+    switch (tok.type)
+    {
+    C(Number):
+    {
+        auto number = fmt::format("{}", toNumber(tok.value));
+        if (number.find_first_of(".en") == std::string::npos)
+        {
+            number += ".0";
+        }
+        return "Value(" + number + ")";
+    }
+    C(String):
+        return "Value(std::string(" + quoted(tok.value) + ", " + std::to_string(tok.value.size()) + "))";
+    C(True):
+        return "Value(true)";
+    C(False):
+        return "Value(false)";
+    C(Null):
+        return "Value()";
+    C(Mysterious):
+        return "Value(Value::Special::Undefined)";
+    default:
+        fail("Unexpected token " + describe(tok) + ", expecting a value");
+    }
+}
+
+std::string Compiler::temporary(const std::string & value)
+{
+    auto name = "t" + std::to_string(temporaries++);
+    out() << "Value " << name << " = " << value << ";\n";
+    return name;
+}
+
+std::string Compiler::read(std::string_view name)
+{
+    // a function name reads as true
+    if (functionIds.contains(std::string(name)))
+    {
+        return "Value(true)";
+    }
+
+    return storage(name);
+}
+
+std::string Compiler::storage(std::string_view name)
+{
+    // functions write their own copy of a variable and read the script's
+    // others, the caller's locals aren't visible
+    auto id = std::to_string(variableId(name));
+    if (function && function->locals.contains(std::string(name)))
+    {
+        return "l" + id;
+    }
+
+    return "g" + id;
+}
+
+void Compiler::requireSet(std::string_view name, std::string_view what)
+{
+    // a local starts as the script's variable, the same as a new one when the script never sets it
+    if (!function || !scriptVariables.contains(std::string(name))
+        || std::find(function->parameters.begin(), function->parameters.end(), name) != function->parameters.end())
+    {
+        return;
+    }
+
+    // the names set by the lines before, in the block of this line or around it
+    std::vector<std::unordered_set<std::string_view>> written(1);
+    for (auto l = function->firstLine; l < line; l++)
+    {
+        auto body = program.getLine(l);
+        if (body.front().type == Token::Type::NewLine)
+        {
+            if (written.size() > 1)
+            {
+                written.pop_back();
+            }
+            continue;
+        }
+        if (body.front().type == Token::Type::Else)
+        {
+            written.back().clear();
+            continue;
+        }
+
+        for (size_t i = 0; i < body.size(); i++)
+        {
+            if (isWritten(body, i))
+            {
+                written.back().insert(body[i].value);
+            }
+        }
+        if (opensBlock(body))
+        {
+            written.emplace_back();
+        }
+    }
+
+    for (const auto & names : written)
+    {
+        if (names.contains(name))
+        {
+            return;
+        }
+    }
+
+    fail("Can't compile " + std::string(what) + " '" + std::string(name) + "' in a function that may not have set it yet, the script's variable isn't the one used");
+}
+
+void Compiler::setPronoun(std::string_view name)
+{
+    out() << "it = &" << storage(name) << ";\n";
+}
+
+size_t Compiler::variableId(std::string_view name)
+{
+    auto [it, inserted] = variables.try_emplace(std::string(name), variableNames.size());
+    if (inserted)
+    {
+        variableNames.emplace_back(name);
+    }
+
+    return it->second;
+}
+
+std::ostream & Compiler::out()
+{
+    return *code << std::string(4 * indent, ' ');
+}
+
+std::string Compiler::quoted(std::string_view text)
+{
+    std::string result = "\"";
+    for (unsigned char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if (c < ' ' || c >= 0x7f)
+        {
+            result += fmt::format("\\{:03o}", c);
+        }
+        else
+        {
+            result += c;
+        }
+    }
+
+    return result + "\"";
+}
+
+std::string Compiler::describe(const TokenRef & tok)
+{
+    std::ostringstream stream;
+    stream << tok;
+    return stream.str();
+}
@@ -0,0 +1,102 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "token.h"
+#include "tokenstore.h"
+
+// translates a program into a C++ translation unit, to be built with
+// value.cpp, output.cpp and input.cpp as its runtime
+class Compiler
+{
+public:
+    explicit Compiler(TokenStore program);
+
+    void emit(std::ostream & out);
+
+private:
+    // an element of an expression in postfix order, as C++ code
+    struct Term {
+        // EndOfFile for a value
+        Token::Type op;
+        std::string code;
+        // the variable read, which can then be called or indexed
+        std::string variable;
+        std::string place;
+    };
+
+    struct Declaration {
+        std::string name;
+        std::vector<std::string> parameters;
+        // the body, up to the line closing it
+        size_t firstLine;
+        size_t endLine;
+        // variables written by the body, the others are the script's ones
+        std::unordered_set<std::string> locals;
+    };
+
+    TokenStore program;
+    std::vector<Declaration> functions;
+    std::unordered_map<std::string, size_t> functionIds;
+    std::unordered_map<size_t, size_t> declarationLines;
+    // the variables set outside of the functions, the others stay undefined there
+    std::unordered_set<std::string> scriptVariables;
+    std::unordered_map<std::string, size_t> variables;
+    std::vector<std::string> variableNames;
+
+    // the statement being translated
+    TokenStore::Line tokens;
+    size_t line = 0;
+    size_t pc = 0;
+    const Declaration * function = nullptr;
+    std::ostringstream * code = nullptr;
+    std::vector<Token::Type> blocks;
+    int indent = 1;
+    int temporaries = 0;
+
+    void findFunctions();
+    void findLocals(Declaration & declaration);
+    void translate(size_t from, size_t to);
+    void statement();
+    void closeBlock();
+    [[noreturn]] void fail(const std::string & message);
+
+    void parseVariable(std::string_view name);
+    void let();
+    void put();
+    void step(Token::Type direction);
+    void rock();
+    std::string roll();
+    void turn();
+    void listen();
+    void loop(Token::Type type);
+
+    std::string expression(bool greedy = true, std::string_view variable = {});
+    std::vector<std::string> list();
+    std::string call(std::string_view name);
+    std::string combine(std::vector<Term> & terms, std::vector<Token::Type> & operators);
+    std::string operand(const TokenRef & tok);
+    std::string literal(const TokenRef & tok);
+    std::string temporary(const std::string & value);
+
+    std::string read(std::string_view name);
+    std::string storage(std::string_view name);
+    // the interpreter builds, rocks, rolls, turns and indexes the variable of
+    // the function's own scope, which only exists once the function set it,
+    // a function is only translated when that can't be the script's variable
+    void requireSet(std::string_view name, std::string_view what);
+    void setPronoun(std::string_view name);
+    size_t variableId(std::string_view name);
+
+    std::ostream & out();
+    static std::string quoted(std::string_view text);
+    static std::string describe(const TokenRef & tok);
+};
+
+#endif // COMPILER_H
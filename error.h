@@ -0,0 +1,24 @@
+#ifndef ERROR_H
+#define ERROR_H
+
+#include <sstream>
+#include <stdexcept>
+
+// a mistake of the script found while running it, left to whoever started
+// the run to report, the message ends with a new line
+class ScriptError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// the message is written as to a stream
+template <typename... Args>
+[[noreturn]] void throwScriptError(const Args & ... args)
+{
+    std::ostringstream message;
+    (message << ... << args);
+    throw ScriptError(message.str());
+}
+
+#endif // ERROR_H
@@ -1,73 +1,912 @@
 #include "evaluator.h"
-#include <iostream>
+#include "error.h"
+#include "grammar.h"
+#include "input.h"
+#include "output.h"
+#include "stream.h"
+#include <algorithm>
 #include <stack>
 #include <cassert>
 #include <cmath>
 #include <optional>
+#include <span>
+#include <unordered_set>
 
 #define C(c) case Token::Type::c
 
-Evaluator::Evaluator(std::vector<Token> tokens)
+Operand::Operand(Value value)
+    : kind { Kind::Value }, value { std::move(value) }
 {
-    std::vector<Token> currentLine;
-    for (auto & token : tokens)
+}
+
+Operand::Operand(std::string_view variable, uint32_t site)
+    : kind { Kind::Variable }, variable { variable }, site { site }
+{
+}
+
+Operand::Operand(Token::Type op)
+    : kind { Kind::Operator }, op { op }
+{
+}
+
+size_t StringHash::operator()(std::string_view text) const
+{
+    return std::hash<std::string_view>{}(text);
+}
+
+Evaluator::Evaluator(const std::vector<Token> & tokens, Evaluator * parent)
+    : parent { parent }
+{
+    program.addLines(tokens);
+    program.addLine({ Token(Token::Type::EndOfFile, "", -1) });
+    prepareLines();
+}
+
+Evaluator::Evaluator(TokenStore program)
+    : program { std::move(program) }, wholeProgram { true }
+{
+    this->program.addEndOfFile();
+    prepareLines();
+}
+
+Evaluator::Evaluator(LineQueue & queue)
+    : stream { &queue }
+{
+}
+
+void Evaluator::append(const std::vector<Token> & tokens)
+{
+    // resume where the previous run stopped, instead of at the end of file
+    program.removeLastLine();
+    line = program.size();
+    pc = 0;
+    // a run stopped by an error may have left blocks and loops open
+    isInFunction.clear();
+    nextEmptyLine = {};
+    loops = {};
+    repeating = false;
+    operands.clear();
+    operators.clear();
+    arguments.clear();
+    // blocks the end of file closed may go on in the new lines, only those
+    // and the new lines are prepared again
+    preparedLines = std::min(reopenFrom, line);
+    openBlocks.clear();
+
+    program.addLines(tokens);
+    program.addLine({ Token(Token::Type::EndOfFile, "", -1) });
+    prepareLines();
+}
+
+void Evaluator::restart(Evaluator * parent)
+{
+    this->parent = parent;
+    line = 0;
+    pc = 0;
+    lastVariableNamed.clear();
+    isInFunction.clear();
+    // emptied in place, every call would allocate new ones otherwise
+    while (nextEmptyLine.size()) nextEmptyLine.pop();
+    while (loops.size()) loops.pop();
+    repeating = false;
+    operands.clear();
+    operators.clear();
+    arguments.clear();
+    while (variables.size())
+    {
+        spareVariables.push_back(variables.extract(variables.begin()));
+    }
+    functions.clear();
+    // what the variable reads resolved to belonged to the previous call
+    generation++;
+}
+
+bool Evaluator::isStreaming() const
+{
+    return stream != nullptr;
+}
+
+bool Evaluator::fetchLines()
+{
+    if (!stream)
     {
-        if (token.type == Token::Type::NewLine)
+        return false;
+    }
+
+    // nothing can jump back to lines already run outside of a loop
+    if (loops.empty())
+    {
+        program.clear();
+        line = 0;
+        preparedLines = 0;
+        openBlocks.clear();
+        constants.clear();
+        invariants.clear();
+    }
+
+    auto chunk = stream->pop();
+    if (chunk.empty())
+    {
+        if (stream->getError().size())
+        {
+            throwScriptError(stream->getError());
+        }
+
+        program.addLine({ Token(Token::Type::EndOfFile, "", -1) });
+        stream = nullptr;
+    }
+    else
+    {
+        program.addLines(chunk);
+    }
+
+    prepareLines();
+    return true;
+}
+
+void Evaluator::prepareLines()
+{
+    generation++;
+    bindings.resize(program.tokenCount());
+    expressionEnds.resize(program.tokenCount());
+    blockExits.resize(program.size(), NoLine);
+    steps.resize(program.size());
+    folded.resize(program.tokenCount());
+    hoisted.resize(program.tokenCount());
+    numeric.resize(program.tokenCount());
+    loopEntries.resize(program.size());
+
+    for (; preparedLines < program.size(); preparedLines++)
+    {
+        auto tokens = program.getLine(preparedLines);
+        if (!tokens.size())
+        {
+            continue;
+        }
+        std::fill_n(hoisted.begin() + tokens.offset(), tokens.size(), 0);
+
+        switch (tokens.front().type)
         {
-            // keep empty lines for "end of block"
-            if (currentLine.empty()) currentLine.push_back(token);
+        C(NewLine):
+            // the empty line closing a block is run, not jumped to
+            if (openBlocks.size())
+            {
+                blockExits[openBlocks.back()] = preparedLines + 1;
+                hoistInvariants(openBlocks.back(), preparedLines);
+                openBlocks.pop_back();
+            }
+            break;
+        C(EndOfFile):
+            reopenFrom = (openBlocks.size() ? openBlocks.front() : preparedLines);
+            // inner loops first, their expressions are hoisted out of them only
+            for (auto block = openBlocks.rbegin(); block != openBlocks.rend(); block++)
+            {
+                blockExits[*block] = preparedLines;
+                hoistInvariants(*block, preparedLines);
+            }
+            openBlocks.clear();
+            break;
+        default:
+            if (opensBlock(tokens))
+            {
+                // a line of a cleared stream may have had another block here
+                blockExits[preparedLines] = NoLine;
+                openBlocks.push_back(preparedLines);
+            }
+        }
 
-            lines.push_back(currentLine);
-            currentLine.clear();
+        steps[preparedLines] = { stepCount(tokens) };
+        if (auto test = loopTest(tokens))
+        {
+            loopTests.insert_or_assign(preparedLines, std::move(*test));
         }
         else
         {
-            currentLine.push_back(token);
+            loopTests.erase(preparedLines);
+        }
+
+        auto last = tokens.size() - 1;
+        expressionEnds[tokens.offset() + last] = tokens.offset() + last;
+        for (auto i = last; i-- > 0;)
+        {
+            expressionEnds[tokens.offset() + i] = isExpressionToken(tokens[i + 1].type, true) ? expressionEnds[tokens.offset() + i + 1] : tokens.offset() + i + 1;
+        }
+
+        if (!wholeProgram)
+        {
+            foldLine(tokens, {});
         }
     }
 
-    if (currentLine.size())
+    if (wholeProgram)
     {
-        lines.push_back(currentLine);
+        auto declarations = declarationLines();
+        foldConstants(declarations);
+        inferTypes(declarations);
     }
+}
+
+void Evaluator::foldLine(const TokenStore::Line & tokens, const Known & known)
+{
+    auto isKnown = [&](std::string_view name) {
+        return !known.empty() && known.contains(name);
+    };
 
-    lines.push_back({ Token(Token::Type::EndOfFile, "", -1) });
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        folded[tokens.offset() + i] = 0;
+        if (!isLiteral(tokens[i].type) && (tokens[i].type != Token::Type::Variable || !isKnown(tokens[i].value)))
+        {
+            continue;
+        }
+
+        auto last = arithmeticRun(tokens, i, isKnown);
+        if (last == tokens.size())
+        {
+            continue;
+        }
+
+        constants.push_back({ calculateRun(tokens, i, last, known), static_cast<uint32_t>(tokens.offset() + last) });
+        folded[tokens.offset() + i] = constants.size();
+    }
 }
 
-void Evaluator::setParent(Evaluator * evaluator)
+size_t Evaluator::arithmeticRun(const TokenStore::Line & tokens, size_t first, const std::function<bool(std::string_view)> & isValue)
 {
-    parent = evaluator;
+    // values joined by arithmetic, ending on a value
+    size_t last = tokens.size();
+    bool value = true;
+    for (auto j = first; j < tokens.size(); j++, value = !value)
+    {
+        auto tok = tokens[j];
+        bool isOperand = tok.type != Token::Type::Variable ? isLiteral(tok.type) : isValue(tok.value);
+        if (value ? !isOperand : !isArithmetic(tok.type))
+        {
+            break;
+        }
+        if (value)
+        {
+            last = j;
+        }
+    }
+
+    if (last == tokens.size())
+    {
+        return last;
+    }
+
+    // the expression must end there, or only be compared and joined with 'and'/'or'
+    switch (tokens[last + 1].type)
+    {
+    C(Is):
+    C(Isnt):
+    C(And):
+    C(Or):
+        return last;
+    default:
+        return isExpressionToken(tokens[last + 1].type, true) ? tokens.size() : last;
+    }
 }
 
-bool Evaluator::setVariable(std::string name, Value value, bool setIfNotExisting)
+Value Evaluator::calculateRun(const TokenStore::Line & tokens, size_t first, size_t last, const Known & known)
 {
-    if ((variables.contains(name))
-            || (!parent || !parent->setVariable(name, value, false)))
+    auto base = operands.size();
+    pushRun(tokens, first, last, known);
+
+    auto result = calculate(std::span(operands).subspan(base));
+    operands.erase(operands.begin() + base, operands.end());
+    return result;
+}
+
+void Evaluator::pushRun(const TokenStore::Line & tokens, size_t first, size_t last, const Known & known)
+{
+    // the postfix order of evaluateExpression(), on its stacks
+    auto base = operators.size();
+    for (auto j = first; j <= last; j++)
+    {
+        auto tok = tokens[j];
+        switch (tok.type)
+        {
+        C(Plus):
+        C(Minus):
+            while (operators.size() > base)
+            {
+                operands.emplace_back(operators.back());
+                operators.pop_back();
+            }
+            operators.push_back(tok.type);
+            break;
+        C(Times):
+        C(Over):
+            operators.push_back(tok.type);
+            break;
+        C(Variable):
+            if (auto value = known.find(tok.value); value != known.end())
+            {
+                operands.emplace_back(value->second);
+                break;
+            }
+            [[fallthrough]];
+        default:
+            operands.push_back(toOperand(tokens, j));
+        }
+    }
+    while (operators.size() > base)
+    {
+        operands.emplace_back(operators.back());
+        operators.pop_back();
+    }
+}
+
+std::vector<bool> Evaluator::declarationLines()
+{
+    std::vector<bool> lines(program.size());
+    for (size_t l = 0; l < program.size(); l++)
+    {
+        if (isFunctionDeclaration(program.getLine(l)))
+        {
+            // up to the line closing the body
+            auto end = bodyEnd(program, l + 1);
+            std::fill(lines.begin() + l, lines.begin() + end + 1, true);
+            l = end;
+        }
+    }
+
+    return lines;
+}
+
+void Evaluator::foldConstants(const std::vector<bool> & declarations)
+{
+    constants.clear();
+
+    // a variable set only once, to a constant, outside of any block and
+    // function, has that value on every line after it
+    std::unordered_map<std::string_view, int> writes;
+    std::unordered_set<std::string_view> functionNames;
+    bool propagate = true;
+    for (size_t l = 0; l < program.size(); l++)
+    {
+        auto tokens = program.getLine(l);
+        if (isFunctionDeclaration(tokens))
+        {
+            functionNames.insert(tokens.front().value);
+        }
+
+        for (size_t i = 0; i < tokens.size(); i++)
+        {
+            if (tokens[i].type == Token::Type::Pronoun && i && tokens[i - 1].type == Token::Type::Build)
+            {
+                propagate = false;
+            }
+            if (isWritten(tokens, i))
+            {
+                writes[tokens[i].value]++;
+            }
+        }
+    }
+
+    Known known;
+    int depth = 0;
+    for (size_t l = 0; l < program.size(); l++)
+    {
+        auto tokens = program.getLine(l);
+        auto type = tokens.front().type;
+
+        // function bodies are run by their own evaluator
+        if (declarations[l])
+        {
+            continue;
+        }
+
+        foldLine(tokens, known);
+
+        std::string_view name;
+        std::optional<Value> value;
+        auto constant = [&](size_t first) -> const Constant * {
+            auto index = folded[tokens.offset() + first];
+            return index ? &constants[index - 1] : nullptr;
+        };
+
+        if (type == Token::Type::Variable && tokens.size() == 3 && (tokens[1].type == Token::Type::Is || tokens[1].type == Token::Type::Says))
+        {
+            name = tokens.front().value;
+            auto literal = tokens[2].type;
+            if (literal == Token::Type::Null && tokens[1].type == Token::Type::Is)
+            {
+                value = Value(0.0);
+            }
+            else if (isLiteral(literal) && (literal == Token::Type::String || tokens[1].type == Token::Type::Is))
+            {
+                value = toOperand(tokens, 2).value;
+            }
+        }
+        else if (type == Token::Type::Let && tokens[1].type == Token::Type::Variable && tokens[2].type == Token::Type::Be)
+        {
+            name = tokens[1].value;
+            if (auto folded = constant(3); folded && folded->last + 1 == tokens.offset() + tokens.size())
+            {
+                value = folded->value;
+            }
+        }
+        else if (type == Token::Type::Put)
+        {
+            if (auto folded = constant(1))
+            {
+                auto into = folded->last - tokens.offset() + 1;
+                if (tokens[into].type == Token::Type::Into && tokens[into + 1].type == Token::Type::Variable && into + 2 == tokens.size())
+                {
+                    name = tokens[into + 1].value;
+                    value = folded->value;
+                }
+            }
+        }
+
+        if (propagate && depth == 0 && value && writes[name] == 1 && !functionNames.contains(name))
+        {
+            known.insert_or_assign(name, std::move(*value));
+        }
+
+        if (type == Token::Type::If || type == Token::Type::While || type == Token::Type::Until)
+        {
+            depth++;
+        }
+        else if (type == Token::Type::NewLine && depth > 0)
+        {
+            depth--;
+        }
+    }
+}
+
+void Evaluator::hoistInvariants(size_t head, size_t end)
+{
+    auto type = program.getLine(head).front().type;
+    if (type != Token::Type::While && type != Token::Type::Until)
+    {
+        return;
+    }
+
+    // the variables the loop changes, any of them once it calls a function
+    // or builds up the pronoun
+    std::unordered_set<std::string_view> written;
+    for (auto l = head; l < end; l++)
+    {
+        auto tokens = program.getLine(l);
+        for (size_t i = 0; i < tokens.size(); i++)
+        {
+            if (tokens[i].type == Token::Type::Taking || (tokens[i].type == Token::Type::Pronoun && i && tokens[i - 1].type == Token::Type::Build))
+            {
+                return;
+            }
+            if (isWritten(tokens, i))
+            {
+                written.insert(tokens[i].value);
+            }
+        }
+    }
+
+    // arithmetic on the others, which the loops inside haven't taken yet
+    auto isInvariant = [&](std::string_view name) {
+        return !written.contains(name);
+    };
+    for (auto l = head; l < end; l++)
+    {
+        auto tokens = program.getLine(l);
+        for (size_t i = 0; i < tokens.size(); i++)
+        {
+            auto index = tokens.offset() + i;
+            if (hoisted[index] || folded[index] || tokens[i].type != Token::Type::Variable)
+            {
+                continue;
+            }
+
+            auto last = arithmeticRun(tokens, i, isInvariant);
+            if (last == tokens.size() || last == i)
+            {
+                continue;
+            }
+
+            invariants.push_back({ Value(), static_cast<uint32_t>(tokens.offset() + last), head, 0 });
+            hoisted[index] = invariants.size();
+        }
+    }
+}
+
+void Evaluator::inferTypes(const std::vector<bool> & declarations)
+{
+    numericRuns.clear();
+    std::fill(numeric.begin(), numeric.end(), 0);
+
+    std::unordered_set<std::string_view> functionNames;
+    for (size_t l = 0; l < program.size(); l++)
+    {
+        auto tokens = program.getLine(l);
+        if (isFunctionDeclaration(tokens))
+        {
+            functionNames.insert(tokens.front().value);
+        }
+    }
+
+    // whether every value given to each variable of this scope is a number,
+    // until none changes: one also given a boolean, a string, an array or
+    // what a function gives back is unknown
+    std::unordered_map<std::string_view, Type> types;
+    auto typeOf = [&](std::string_view name) {
+        auto type = types.find(name);
+        return functionNames.contains(name) ? Type::Unknown : type != types.end() ? type->second : Type::Unset;
+    };
+    auto literalType = [](Token::Type literal) {
+        switch (literal)
+        {
+        C(Number):
+            return Type::Number;
+        default:
+            return Type::Unknown;
+        }
+    };
+    // a single operand, or arithmetic on numbers, which starts on the
+    // variable it is given to when it starts on an operator
+    auto expressionType = [&](const TokenStore::Line & tokens, size_t first, size_t end, std::string_view name) {
+        std::vector<Type> operands;
+        bool value = true;
+        if (first < end && isArithmetic(tokens[first].type))
+        {
+            operands.push_back(typeOf(name));
+            value = false;
+        }
+        for (auto i = first; i < end; i++, value = !value)
+        {
+            if (!value)
+            {
+                if (!isArithmetic(tokens[i].type))
+                {
+                    return Type::Unknown;
+                }
+                continue;
+            }
+            operands.push_back(tokens[i].type == Token::Type::Variable ? typeOf(tokens[i].value) : literalType(tokens[i].type));
+        }
+
+        if (value || operands.empty())
+        {
+            return Type::Unknown;
+        }
+        if (operands.size() == 1)
+        {
+            return operands.front();
+        }
+        auto type = Type::Unset;
+        for (auto operand : operands)
+        {
+            if (operand != Type::Number && operand != Type::Unset)
+            {
+                return Type::Unknown;
+            }
+            type = std::max(type, operand);
+        }
+        return type;
+    };
+
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (size_t l = 0; l < program.size(); l++)
+        {
+            auto tokens = program.getLine(l);
+            for (size_t i = 0; i < tokens.size(); i++)
+            {
+                auto previous = (i ? tokens[i - 1].type : Token::Type::NewLine);
+                auto type = Type::Unknown;
+
+                if (previous == Token::Type::Let && i + 1 < tokens.size() && tokens[i + 1].type == Token::Type::At)
+                {
+                    // an element, of this scope or, from a function, of the first one having it
+                }
+                else if (declarations[l] || !isWritten(tokens, i))
+                {
+                    continue;
+                }
+                else if (previous == Token::Type::Let)
+                {
+                    type = expressionType(tokens, i + 2, tokens.size(), tokens[i].value);
+                }
+                else if (previous == Token::Type::Into && tokens.front().type == Token::Type::Put)
+                {
+                    type = expressionType(tokens, 1, i - 1, {});
+                }
+                else if (previous == Token::Type::Build || previous == Token::Type::Knock || previous == Token::Type::Up || previous == Token::Type::Down)
+                {
+                    // numbers and booleans keep their type
+                    continue;
+                }
+                else if (previous == Token::Type::NewLine && tokens.size() > 2)
+                {
+                    // a poetic null is a zero
+                    auto literal = tokens[2].type;
+                    type = (tokens[1].type == Token::Type::Says ? Type::Unknown : literal == Token::Type::Null ? Type::Number : literalType(literal));
+                }
+
+                auto & known = types.try_emplace(tokens[i].value, Type::Unset).first->second;
+                auto joined = (known == Type::Unset || known == type ? type : type == Type::Unset ? known : Type::Unknown);
+                if (joined != known)
+                {
+                    known = joined;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    // arithmetic on numbers only, calculated without values
+    auto isNumber = [&](std::string_view name) {
+        return typeOf(name) == Type::Number;
+    };
+    for (size_t l = 0; l < program.size(); l++)
+    {
+        auto tokens = program.getLine(l);
+        if (declarations[l])
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < tokens.size(); i++)
+        {
+            auto index = tokens.offset() + i;
+            if (folded[index] || hoisted[index] || (tokens[i].type != Token::Type::Variable && tokens[i].type != Token::Type::Number))
+            {
+                continue;
+            }
+
+            auto last = arithmeticRun(tokens, i, isNumber);
+            if (last == tokens.size() || last == i || last - i >= MaxNumericRun)
+            {
+                continue;
+            }
+            bool numbers = true;
+            for (auto j = i; j <= last; j += 2)
+            {
+                numbers = numbers && (tokens[j].type == Token::Type::Variable || tokens[j].type == Token::Type::Number);
+            }
+            if (!numbers)
+            {
+                continue;
+            }
+
+            NumericRun run { {}, {}, static_cast<uint32_t>(tokens.offset() + last) };
+            auto base = operands.size();
+            pushRun(tokens, i, last, {});
+            for (auto operand = operands.begin() + base; operand != operands.end(); operand++)
+            {
+                switch (operand->kind)
+                {
+                case Operand::Kind::Operator:
+                    run.terms.push_back({ operand->op });
+                    break;
+                case Operand::Kind::Value:
+                    run.terms.push_back({ Token::Type::EndOfFile, operand->value.asDouble() });
+                    break;
+                case Operand::Kind::Variable:
+                    run.terms.push_back({ Token::Type::EndOfFile, 0, static_cast<uint32_t>(run.variables.size()) });
+                    run.variables.push_back(std::move(*operand));
+                    break;
+                }
+            }
+            operands.erase(operands.begin() + base, operands.end());
+
+            numericRuns.push_back(std::move(run));
+            numeric[index] = numericRuns.size();
+        }
+    }
+}
+
+bool Evaluator::calculateNumbers(const NumericRun & run, double & result)
+{
+    double stack[MaxNumericRun / 2 + 1];
+    size_t top = 0;
+    for (const auto & term : run.terms)
+    {
+        switch (term.op)
+        {
+        C(Plus):
+            top--;
+            stack[top - 1] += stack[top];
+            break;
+        C(Minus):
+            top--;
+            stack[top - 1] -= stack[top];
+            break;
+        C(Times):
+            top--;
+            stack[top - 1] *= stack[top];
+            break;
+        C(Over):
+            top--;
+            stack[top - 1] /= stack[top];
+            break;
+        default:
+            if (term.variable == NumericTerm::NoVariable)
+            {
+                stack[top++] = term.number;
+            }
+            else if (auto number = readVariable(run.variables[term.variable]).number())
+            {
+                stack[top++] = *number;
+            }
+            else
+            {
+                // not set yet, the expression is evaluated with values
+                return false;
+            }
+        }
+    }
+
+    result = stack[0];
+    return true;
+}
+
+int Evaluator::stepCount(const TokenStore::Line & tokens)
+{
+    auto type = tokens.front().type;
+    if ((type != Token::Type::Build && type != Token::Type::Knock) || tokens[1].type != Token::Type::Variable)
+    {
+        return 0;
+    }
+
+    auto direction = (type == Token::Type::Build ? Token::Type::Up : Token::Type::Down);
+    int count = 0;
+    for (size_t i = 2; i < tokens.size(); i++)
+    {
+        if (tokens[i].type == direction)
+        {
+            count++;
+        }
+        else if (tokens[i].type != Token::Type::Comma)
+        {
+            return 0;
+        }
+    }
+
+    return type == Token::Type::Build ? count : -count;
+}
+
+std::optional<Evaluator::LoopTest> Evaluator::loopTest(const TokenStore::Line & tokens)
+{
+    auto type = tokens.front().type;
+    if ((type != Token::Type::While && type != Token::Type::Until) || tokens[1].type != Token::Type::Variable
+        || (tokens[2].type != Token::Type::Is && tokens[2].type != Token::Type::Isnt))
+    {
+        return {};
+    }
+
+    auto op = Operator::Equal;
+    size_t other = 3;
+    switch (tokens[3].type)
+    {
+    C(Greater):
+    C(Lower):
+        if (tokens[4].type != Token::Type::Than)
+        {
+            return {};
+        }
+        op = (tokens[3].type == Token::Type::Greater ? Operator::GreaterThan : Operator::LowerThan);
+        other = 5;
+        break;
+    C(As):
+        if ((tokens[4].type != Token::Type::Great && tokens[4].type != Token::Type::Little) || tokens[5].type != Token::Type::As)
+        {
+            return {};
+        }
+        op = (tokens[4].type == Token::Type::Great ? Operator::GreaterOrEqual : Operator::LowerOrEqual);
+        other = 6;
+        break;
+    default:
+        break;
+    }
+
+    switch (tokens[other].type)
+    {
+    C(Number):
+    C(String):
+    C(True):
+    C(False):
+    C(Null):
+    C(Mysterious):
+    C(Variable):
+        break;
+    default:
+        return {};
+    }
+
+    if (other + 1 != tokens.size())
+    {
+        return {};
+    }
+
+    return LoopTest { toOperand(tokens, 1), op, tokens[2].type == Token::Type::Isnt, toOperand(tokens, other) };
+}
+
+void Evaluator::step(Step & step)
+{
+    auto name = tokens[1].value;
+
+    if (step.generation != generation)
+    {
+        // knock reads a variable of any scope, it can only be changed in place once it is local
+        if (step.count < 0 && !variables.contains(name))
+        {
+            knock();
+            return;
+        }
+
+        step.variable = &localVariable(name);
+        step.generation = generation;
+    }
+
+    auto & variable = *step.variable;
+    if (variable.isDouble())
+    {
+        variable = Value(variable.asDouble() + step.count);
+    }
+    else if (variable.isBool())
+    {
+        if (step.count % 2)
+        {
+            variable = Value(!variable.asBool());
+        }
+    }
+    else
+    {
+        throwScriptError("You can't ", (step.count > 0 ? "increment" : "decrement"), " a variable that is not a number or a boolean, on line ", tokens[1].line, '\n');
+    }
+
+    pc = tokens.size() - 1;
+}
+
+void Evaluator::setVariable(std::string_view name, Value value)
+{
+    localVariable(name) = std::move(value);
+}
+
+bool Evaluator::setVariable(std::string_view name, int index, Value value)
+{
+    // the innermost scope having the variable gets it, the outermost one otherwise
+    auto scope = this;
+    while (!scope->variables.contains(name) && scope->parent)
+    {
+        scope = scope->parent;
+    }
+
+    auto & variable = scope->localVariable(name);
+    if (!variable.isArray())
     {
-        if (setIfNotExisting)
-        {
-            variables[name] = value;
-            return true;
-        }
+        variable = Value(Value::Special::Array);
     }
+    variable.setIndex(index, std::move(value));
 
-    return false;
+    return scope == this;
 }
 
-bool Evaluator::setVariable(std::string name, int index, Value value)
+Value & Evaluator::localVariable(std::string_view name)
 {
-    if ((variables.contains(name))
-            || (!parent || !parent->setVariable(name, index, value)))
+    auto it = variables.find(name);
+    if (it == variables.end())
     {
-        if (!variables[name].isArray())
+        if (spareVariables.size())
         {
-            variables[name] = Value(Value::Special::Array);
+            auto node = std::move(spareVariables.back());
+            spareVariables.pop_back();
+            node.key() = name;
+            node.mapped() = Value();
+            it = variables.insert(std::move(node)).position;
         }
-        variables[name] = value;
-        return true;
+        else
+        {
+            it = variables.emplace(name, Value()).first;
+        }
+        // it may hide a variable of a parent
+        generation++;
     }
 
-    return false;
+    return it->second;
 }
 
 Value Evaluator::eval()
@@ -75,17 +914,22 @@ Value Evaluator::eval()
     int skippingBlocks = 0;
     int depth = 0;
 
-    while (line < lines.size())
+    while (line < program.size() || fetchLines())
     {
-        tokens = lines[line++];
+        tokens = program.getLine(line++);
         pc = 1;
         auto tok = tokens.front();
 
         if (isInFunction.size())
         {
+            // lines that stay in the program are copied when the function is first called
+            bool copy = (functionStart == NoLine);
             if (tok.type == Token::Type::NewLine)
             {
-                functions[isInFunction].addToken(tok);
+                if (copy)
+                {
+                    functions[isInFunction].addToken(Token(tok.type, std::string(tok.value), tok.line));
+                }
                 if (depth > 0)
                 {
                     depth--;
@@ -93,6 +937,10 @@ Value Evaluator::eval()
                 }
 
                 // an empty line finishes a function declaration
+                if (!copy)
+                {
+                    functions[isInFunction].setSource(program, functionStart, line);
+                }
                 isInFunction.clear();
             }
             else
@@ -108,11 +956,17 @@ Value Evaluator::eval()
                     ;
                 }
 
-                for (auto tok : tokens)
+                if (!copy)
                 {
-                    functions[isInFunction].addToken(tok);
+                    continue;
+                }
+                auto & function = functions[isInFunction];
+                for (size_t i = 0; i < tokens.size(); i++)
+                {
+                    auto t = tokens[i];
+                    function.addToken(Token(t.type, std::string(t.value), t.line));
                 }
-                functions[isInFunction].addToken(Token(Token::Type::NewLine, "", tok.line));
+                function.addToken(Token(Token::Type::NewLine, "", tok.line));
                 continue;
             }
         }
@@ -143,6 +997,11 @@ Value Evaluator::eval()
             continue;
         }
 
+        if (isTakeItToTheTop(tokens))
+        {
+            tok.type = Token::Type::Continue;
+        }
+
         switch (tok.type)
         {
         C(Variable):
@@ -164,13 +1023,14 @@ Value Evaluator::eval()
                 {
                     line = loops.top();
                     loops.pop();
+                    repeating = true;
                 }
             }
             continue;
         }
         C(Shout):
         {
-            std::cout << evaluateExpression() << '\n';
+            Output::standard() << evaluateExpression() << '\n';
             break;
         }
         C(Let):
@@ -184,13 +1044,21 @@ Value Evaluator::eval()
             break;
         }
         C(Build):
-        {
-            build();
-            break;
-        }
         C(Knock):
         {
-            knock();
+            auto & counted = steps[line - 1];
+            if (counted.count)
+            {
+                step(counted);
+            }
+            else if (tok.type == Token::Type::Build)
+            {
+                build();
+            }
+            else
+            {
+                knock();
+            }
             break;
         }
         C(Give):
@@ -217,11 +1085,10 @@ Value Evaluator::eval()
 
                 if (tok.type != Token::Type::Variable)
                 {
-                    std::cerr << "----\n";
-                    std::exit(1);
+                    throwScriptError("----\n");
                 }
 
-                variables[tok.value] = val;
+                localVariable(tok.value) = std::move(val);
 
                 pc++;
             }
@@ -233,6 +1100,11 @@ Value Evaluator::eval()
             turn();
             break;
         }
+        C(Listen):
+        {
+            listen();
+            break;
+        }
         C(If):
         {
             auto b = evaluateExpression();
@@ -254,8 +1126,27 @@ Value Evaluator::eval()
         C(Until):
         C(While):
         {
-            auto res = evaluateExpression();
-            if (res.asBool() == (tok.type == Token::Type::While))
+            if (!repeating)
+            {
+                loopEntries[line - 1]++;
+            }
+            repeating = false;
+
+            bool res;
+            auto test = loopTests.find(line - 1);
+            if (test != loopTests.end())
+            {
+                const auto & [variable, op, negate, other] = test->second;
+                const auto & right = (other.kind == Operand::Kind::Variable ? readVariable(other) : other.value);
+                res = compare(op, readVariable(variable), right) != negate;
+                pc = tokens.size() - 1;
+            }
+            else
+            {
+                res = evaluateExpression().asBool();
+            }
+
+            if (res == (tok.type == Token::Type::While))
             {
                 loops.push(line - 1);
                 nextEmptyLine.push(tok.type);
@@ -267,58 +1158,120 @@ Value Evaluator::eval()
             break;
         }
         C(Break):
-        {
-            break;
-        }
         C(Continue):
         {
+            // "break it down", "take it to the top"
+            if (tok.type == Token::Type::Break && tokens[pc].type == Token::Type::Pronoun && tokens[pc + 1].type == Token::Type::Down)
+            {
+                pc += 2;
+            }
+            else if (tok.type == Token::Type::Continue && tokens[pc].type == Token::Type::Pronoun
+                     && tokens[pc + 1].value == "to" && tokens[pc + 2].value == "the top")
+            {
+                pc += 3;
+            }
+
+            if (loops.empty())
+            {
+                throwScriptError("'", tok.value, "' outside of a loop on line ", tok.line, '\n');
+            }
+
+            // leave the blocks opened inside the loop, then the loop itself
+            int blocks = 0;
+            while (nextEmptyLine.top() != Token::Type::While && nextEmptyLine.top() != Token::Type::Until)
+            {
+                nextEmptyLine.pop();
+                blocks++;
+            }
+            nextEmptyLine.pop();
+
+            auto head = loops.top();
+            loops.pop();
+
+            if (tok.type == Token::Type::Continue)
+            {
+                line = head;
+                repeating = true;
+            }
+            else if (blockExits[head] != NoLine)
+            {
+                line = blockExits[head];
+            }
+            else
+            {
+                // the end of the loop hasn't been streamed in yet
+                skippingBlocks = blocks + 1;
+            }
             break;
         }
         default:
-            std::cerr << "Unexpected token " << tok << " on line " << tok.line << '\n';
-            std::exit(1);
+            throwScriptError("Unexpected token ", tok, " on line ", tok.line, '\n');
         }
 
         if (pc + 1 < tokens.size())
         {
-            std::cerr << "Not everything has been eaten on line " << line << " (" << pc << " " << tokens.size() << ")\n";
-            std::exit(1);
+            throwScriptError("Not everything has been eaten on line ", line, " (", pc, " ", tokens.size(), ")\n");
         }
     }
 
     return Value();
 }
 
-Value Evaluator::getVariable(std::string name)
+const Value & Evaluator::getVariable(std::string_view name) const
 {
-    if (variables.contains(name))
+    static const Value undefined(Value::Special::Undefined);
+
+    auto it = variables.find(name);
+    if (it != variables.end())
     {
-        return variables[name];
+        return it->second;
     }
     else if (parent)
     {
         return parent->getVariable(name);
     }
 
-    return Value(Value::Special::Undefined);
+    return undefined;
 }
 
-Function & Evaluator::getFunction(std::string name)
+Function & Evaluator::getFunction(std::string_view name)
 {
-    if (functions.contains(name))
+    auto it = functions.find(name);
+    if (it != functions.end())
     {
-        return functions[name];
+        return it->second;
     }
     else if (parent)
     {
         return parent->getFunction(name);
     }
 
-    std::cerr << "Trying to get a non-existing function called '" << name << "'\n";
-    std::exit(1);
+    throwScriptError("Trying to get a non-existing function called '", name, "'\n");
+}
+
+const Value & Evaluator::readVariable(const Operand & operand)
+{
+    static const Value function(true);
+
+    if (operand.site != Operand::NoSite && bindings[operand.site].generation == generation)
+    {
+        auto variable = bindings[operand.site].variable;
+        return variable ? *variable : function;
+    }
+
+    // a function name reads as true
+    const Value * variable = hasFunction(operand.variable) ? &function : &getVariable(operand.variable);
+
+    // an undefined variable may be declared later in any scope, it isn't kept
+    if (operand.site != Operand::NoSite && !variable->isUndefined())
+    {
+        bindings[operand.site] = { generation, variable == &function ? nullptr : variable };
+    }
+
+    return *variable;
 }
 
-bool Evaluator::hasFunction(std::string name)
+bool Evaluator::hasFunction(std::string_view name) const
 {
     if (functions.contains(name))
     {
@@ -332,7 +1285,7 @@ bool Evaluator::hasFunction(std::string name)
     return false;
 }
 
-void Evaluator::parseVariable(std::string name)
+void Evaluator::parseVariable(std::string_view name)
 {
     const auto & tok = tokens[pc++];
 
@@ -361,12 +1314,11 @@ void Evaluator::parseVariable(std::string name)
         break;
     }
     default:
-        std::cerr << "Unexpected token " << tok << " after variable on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, " after variable on line ", tok.line, '\n');
     }
 }
 
-void Evaluator::parsePoeticNumberVariable(std::string name)
+void Evaluator::parsePoeticNumberVariable(std::string_view name)
 {
     const auto & tok = tokens[pc++];
 
@@ -374,7 +1326,7 @@ void Evaluator::parsePoeticNumberVariable(std::string name)
     {
     C(Number):
     {
-        auto d = std::stod(tok.value);
+        auto d = toNumber(tok.value);
         setVariable(name, Value(d));
         break;
     }
@@ -391,15 +1343,14 @@ void Evaluator::parsePoeticNumberVariable(std::string name)
         setVariable(name, Value(Value::Special::Undefined));
         break;
     C(String):
-        setVariable(name, Value(tok.value));
+        setVariable(name, Value(std::string(tok.value)));
         break;
     default:
-        std::cerr << "Unexpected token " << tok << " after 'is' on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, " after 'is' on line ", tok.line, '\n');
     }
 }
 
-void Evaluator::parsePoeticStringVariable(std::string name)
+void Evaluator::parsePoeticStringVariable(std::string_view name)
 {
     const auto & tok = tokens[pc++];
 
@@ -407,50 +1358,104 @@ void Evaluator::parsePoeticStringVariable(std::string name)
     {
     C(String):
     {
-        setVariable(name, Value(tok.value));
+        setVariable(name, Value(std::string(tok.value)));
         break;
     }
     default:
-        std::cerr << "Unexpected token " << tok << " after 'says' on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, " after 'says' on line ", tok.line, '\n');
     }
 }
 
-Value Evaluator::evaluateExpression(bool greedy, std::string variable)
+Value Evaluator::evaluateExpression(bool greedy, std::string_view variable)
 {
     auto current = tokens[pc];
 
-    std::vector<Token> result;
-    std::stack<Token> stack;
+    // the operands and operators of enclosing expressions stay below these
+    auto operandsBase = operands.size();
+    auto operatorsBase = operators.size();
 
-    auto evalExpr = [&]() {
-        while (!stack.empty())
+    auto popOperators = [&]() {
+        while (operators.size() > operatorsBase)
         {
-            result.push_back(stack.top());
-            stack.pop();
+            operands.emplace_back(operators.back());
+            operators.pop_back();
         }
+    };
+
+    auto evalExpr = [&]() {
+        popOperators();
 
-        auto res = calculate(result);
-        result.clear();
+        auto res = calculate(std::span(operands).subspan(operandsBase));
+        operands.erase(operands.begin() + operandsBase, operands.end());
         return res;
     };
 
+    // a nested expression stops on the token after it, or on its last one
+    // at the end of the line, the loop below goes on after its last one
+    auto stepBackOnOperand = [&]() {
+        if (pc + 1 < tokens.size() || !isExpressionToken(tokens[pc].type, true))
+        {
+            pc--;
+        }
+    };
+
     std::optional<bool> shortCircuitResult;
 
+    // a constant expression, calculated when the line was prepared, or one
+    // the loop doesn't change, calculated at its first use in the loop
+    const Value * precalculated = nullptr;
+    uint32_t last = 0;
+    std::optional<Value> number;
+    if (greedy && folded[tokens.offset() + pc])
+    {
+        const auto & constant = constants[folded[tokens.offset() + pc] - 1];
+        precalculated = &constant.value;
+        last = constant.last;
+    }
+    else if (greedy && hoisted[tokens.offset() + pc])
+    {
+        auto & invariant = invariants[hoisted[tokens.offset() + pc] - 1];
+        if (invariant.entry != loopEntries[invariant.head])
+        {
+            invariant.value = calculateRun(tokens, pc, invariant.last - tokens.offset(), {});
+            invariant.entry = loopEntries[invariant.head];
+        }
+        precalculated = &invariant.value;
+        last = invariant.last;
+    }
+    else if (greedy && numeric[tokens.offset() + pc])
+    {
+        const auto & run = numericRuns[numeric[tokens.offset() + pc] - 1];
+        if (double result; calculateNumbers(run, result))
+        {
+            number.emplace(result);
+            precalculated = &*number;
+            last = run.last;
+        }
+    }
+
+    if (precalculated)
+    {
+        operands.emplace_back(*precalculated);
+        pc = last - tokens.offset();
+
+        if (pc + 1 < tokens.size())
+        {
+            current = tokens[++pc];
+        }
+        else
+        {
+            current = tokens[tokens.size()];
+        }
+    }
+
     while (isExpressionToken(current.type, greedy))
     {
         if (shortCircuitResult.has_value())
         {
-            if (pc + 1 < tokens.size())
-            {
-                // skip the rest of the expression
-                current = tokens[++pc];
-                continue;
-            }
-            else
-            {
-                break;
-            }
+            // skip the rest of the expression
+            pc = expressionEnds[tokens.offset() + pc] - tokens.offset();
+            break;
         }
 
         switch (current.type)
@@ -460,97 +1465,103 @@ Value Evaluator::evaluateExpression(bool greedy, std::string variable)
         C(True):
         C(False):
         C(Null):
-        C(Not):
         C(Mysterious):
-            result.push_back(current);
+        C(Variable):
+            operands.push_back(toOperand(tokens, pc));
+            break;
+        C(Not):
+            operands.emplace_back(current.type);
             break;
         C(Plus):
         C(Minus):
         {
-            if (!result.size() && variable.size())
+            if (operands.size() == operandsBase && variable.size())
             {
-                result.emplace_back(Token::Type::Variable, variable, current.line);
+                operands.emplace_back(variable);
             }
 
-            while (!stack.empty())
-            {
-                result.push_back(stack.top());
-                stack.pop();
-            }
-            stack.push(current);
+            popOperators();
+            operators.push_back(current.type);
             break;
         }
         C(Times):
         C(Over):
-            if (!result.size() && variable.size())
+            if (operands.size() == operandsBase && variable.size())
             {
-                result.emplace_back(Token::Type::Variable, variable, current.line);
+                operands.emplace_back(variable);
             }
 
-            stack.push(current);
-            break;
-        C(Variable):
-            result.push_back(current);
+            operators.push_back(current.type);
             break;
         C(Pronoun):
-            result.emplace_back(Token::Type::Variable, lastVariableNamed, current.line);
+            operands.emplace_back(std::string_view(lastVariableNamed));
             break;
         C(Taking):
         {
-            if (result.size() == 0 || result.back().type != Token::Type::Variable)
+            if (operands.size() == operandsBase || operands.back().kind != Operand::Kind::Variable)
             {
-                if (result.size() == 0)
+                if (operands.size() == operandsBase)
                 {
-                    std::cerr << "Unexpected 'taking', trying to call a fuction without naming it on line " << current.line << '\n';
+                    throwScriptError("Unexpected 'taking', trying to call a fuction without naming it on line ", current.line, '\n');
+                }
+                else if (operands.back().kind == Operand::Kind::Operator)
+                {
+                    throwScriptError("Trying to call ", TokenRef(operands.back().op, {}, current.line), " on line ", current.line, '\n');
                 }
                 else
                 {
-                    std::cerr << "Trying to call " << result.back() << " on line " << current.line << '\n';
+                    throwScriptError("Trying to call ", Token(operands.back().value, current.line), " on line ", current.line, '\n');
                 }
-                std::exit(1);
             }
             pc++;
-            auto res = executeFunction(result.back().value);
+            auto res = executeFunction(operands.back().variable);
             pc--;
-            pc--;
-            result.pop_back();
-            result.push_back(Token(res, current.line));
+            stepBackOnOperand();
+            operands.back() = Operand(std::move(res));
             break;
         }
         C(At):
         {
-            if (result.size() == 0 || result.back().type != Token::Type::Variable)
+            if (operands.size() == operandsBase || operands.back().kind != Operand::Kind::Variable)
             {
-                std::cerr << "Unexpected 'at' on line " << current.line << '\n';
-                std::exit(1);
+                throwScriptError("Unexpected 'at' on line ", current.line, '\n');
             }
 
+            // the index may roll and rename the pronoun the variable came from
+            std::string variableName(operands.back().variable);
+
             pc++;
             auto index = evaluateExpression();
 
             if (!index.isDouble())
             {
-                std::cerr << "An array can only be indexed with numbers, on line " << result.back().line << '\n';
-                std::exit(1);
+                throwScriptError("An array can only be indexed with numbers, on line ", current.line, '\n');
             }
 
-            pc--;
+            stepBackOnOperand();
 
-            auto variableName = result.back().value;
-            const auto & var = variables[variableName];
+            const auto & var = localVariable(variableName);
 
             auto res = var.getIndex(static_cast<int>(index.asDouble()));
-            auto type = res.type();
 
-            result.pop_back();
-            result.push_back(Token(res, current.line));
+            operands.back() = Operand(std::move(res));
             break;
         }
         C(Roll):
         {
+            // rolling renames the pronoun, read the variables it named until now
+            for (auto i = operandsBase; i < operands.size(); i++)
+            {
+                auto & operand = operands[i];
+                if (operand.kind == Operand::Kind::Variable && operand.variable.data() == lastVariableNamed.data())
+                {
+                    operand = Operand(calculate({ &operand, 1 }));
+                }
+            }
+
             pc++;
             auto val = roll();
-            result.push_back(Token(val, current.line));
+            operands.emplace_back(std::move(val));
             pc--;
             break;
         }
@@ -563,35 +1574,13 @@ Value Evaluator::evaluateExpression(bool greedy, std::string variable)
             auto op = checkOperator();
 
             pc++;
-            auto other = tokens[pc];
-            auto val2 = calculate({ other });
-
-            bool res = false;
-            switch (op)
-            {
-            case Operator::Equal:
-                res = val == val2;
-                break;
-            case Operator::NotEqual:
-                res = val == val2;
-                break;
-            case Operator::GreaterOrEqual:
-                res = val >= val2;
-                break;
-            case Operator::GreaterThan:
-                res = val > val2;
-                break;
-            case Operator::LowerOrEqual:
-                res = val <= val2;
-                break;
-            case Operator::LowerThan:
-                res = val < val2;
-                break;
-            }
+            auto other = toOperand(tokens, pc);
+            auto val2 = calculate({ &other, 1 });
 
+            bool res = compare(op, val, val2);
             if (negate) res = !res;
 
-            result.push_back(Token(Value(res), current.line));
+            operands.emplace_back(Value(res));
             break;
         }
         C(And):
@@ -627,8 +1616,7 @@ Value Evaluator::evaluateExpression(bool greedy, std::string variable)
             break;
         }
         default:
-            std::cerr << "Unexpected token " << current << " in expression on line " << current.line << '\n';
-            std::exit(1);
+            throwScriptError("Unexpected token ", current, " in expression on line ", current.line, '\n');
         }
 
         if (pc + 1 >= tokens.size())
@@ -643,6 +1631,8 @@ Value Evaluator::evaluateExpression(bool greedy, std::string variable)
 
     if (shortCircuitResult.has_value())
     {
+        operands.erase(operands.begin() + operandsBase, operands.end());
+        operators.resize(operatorsBase);
         return Value(shortCircuitResult.value());
     }
     else
@@ -655,7 +1645,7 @@ Array Evaluator::evaluateList()
 {
     Array result;
 
-    Token tok = tokens[pc];
+    auto tok = tokens[pc];
     do
     {
         tok = tokens[pc];
@@ -663,8 +1653,7 @@ Array Evaluator::evaluateList()
         {
             tok = tokens[++pc];
         }
-        auto value = evaluateExpression();
-        result.push_back(value);
+        result.push_back(evaluateExpression());
 
         tok = tokens[pc++];
     } while (tok.type == Token::Type::Comma);
@@ -673,88 +1662,72 @@ Array Evaluator::evaluateList()
     return result;
 }
 
-Value Evaluator::calculate(std::vector<Token> result)
+Value Evaluator::calculate(std::span<const Operand> expression)
 {
     bool nextIsNegated = false;
-    std::stack<Value> values;
-    for (auto res : result)
+    auto & values = calculation;
+    values.clear();
+    for (const auto & res : expression)
     {
-        switch (res.type)
+        switch (res.kind)
         {
-        C(Not):
-            nextIsNegated = !nextIsNegated;
+        case Operand::Kind::Value:
+            values.push_back(res.value);
             break;
-        C(Number):
-            values.push(Value(std::stod(res.value)));
-            break;
-        C(String):
-            values.push(Value(res.value));
-            break;
-        C(True):
-            values.push(Value(true));
-            break;
-        C(False):
-            values.push(Value(false));
-            break;
-        C(Null):
-            values.push(Value());
-            break;
-        C(Mysterious):
-            values.push(Value(Value::Special::Undefined));
+        case Operand::Kind::Variable:
+            values.push_back(readVariable(res));
             break;
-        C(Variable):
+        case Operand::Kind::Operator:
         {
-            if (hasFunction(res.value))
+            switch (res.op)
             {
-                values.push(Value(true));
+            C(Not):
+                nextIsNegated = !nextIsNegated;
+                break;
+            C(Plus):
+            {
+                assert(values.size() >= 2);
+                auto r = std::move(values.back()); values.pop_back();
+                auto l = std::move(values.back()); values.pop_back();
+                values.push_back(l + r);
+                break;
             }
-            else
+            C(Minus):
             {
-                values.push(getVariable(res.value));
+                assert(values.size() >= 2);
+                auto r = std::move(values.back()); values.pop_back();
+                auto l = std::move(values.back()); values.pop_back();
+                values.push_back(l - r);
+                break;
+            }
+            C(Times):
+            {
+                assert(values.size() >= 2);
+                auto r = std::move(values.back()); values.pop_back();
+                auto l = std::move(values.back()); values.pop_back();
+                values.push_back(l * r);
+                break;
+            }
+            C(Over):
+            {
+                assert(values.size() >= 2);
+                auto r = std::move(values.back()); values.pop_back();
+                auto l = std::move(values.back()); values.pop_back();
+                values.push_back(l / r);
+                break;
+            }
+            default:
+                throw 42;
             }
             break;
         }
-        C(Plus):
-        {
-            assert(values.size() >= 2);
-            auto r = values.top(); values.pop();
-            auto l = values.top(); values.pop();
-            values.push(l + r);
-            break;
-        }
-        C(Minus):
-        {
-            assert(values.size() >= 2);
-            auto r = values.top(); values.pop();
-            auto l = values.top(); values.pop();
-            values.push(l - r);
-            break;
-        }
-        C(Times):
-        {
-            assert(values.size() >= 2);
-            auto r = values.top(); values.pop();
-            auto l = values.top(); values.pop();
-            values.push(l * r);
-            break;
-        }
-        C(Over):
-        {
-            assert(values.size() >= 2);
-            auto r = values.top(); values.pop();
-            auto l = values.top(); values.pop();
-            values.push(l / r);
-            break;
-        }
-        default:
-            throw 42;
         }
 
-        if (nextIsNegated && res.type != Token::Type::Not)
+        if (nextIsNegated && res.op != Token::Type::Not)
         {
-            auto v = values.top();
-            values.pop();
-            values.push(Value(!v.asBool()));
+            auto v = values.back();
+            values.pop_back();
+            values.push_back(Value(!v.asBool()));
             nextIsNegated = false;
         }
     }
@@ -764,39 +1737,74 @@ Value Evaluator::calculate(std::vector<Token> result)
         throw 69;
     }
 
-    return Value(values.top());
+    return std::move(values.back());
 }
 
-bool Evaluator::isExpressionToken(Token::Type type, bool greedy)
+Operand Evaluator::toOperand(const TokenStore::Line & tokens, size_t index)
 {
-    switch (type)
+    auto tok = tokens[index];
+
+    switch (tok.type)
     {
     C(Number):
-    C(Variable):
+        return Operand(Value(toNumber(tok.value)));
     C(String):
+        return Operand(Value(std::string(tok.value)));
     C(True):
+        return Operand(Value(true));
     C(False):
+        return Operand(Value(false));
     C(Null):
-    C(Pronoun):
+        return Operand(Value());
     C(Mysterious):
-        return true;
-    C(Plus):
-    C(Minus):
-    C(Times):
-    C(Over):
-    C(Taking):
-    C(At):
-    C(Roll):
-    C(Turn):
-    C(And):
-    C(Or):
-    C(Not):
-    C(Is):
-    C(Isnt):
-        return greedy;
+        return Operand(Value(Value::Special::Undefined));
+    C(Variable):
+        return Operand(tok.value, tokens.offset() + index);
     default:
-        return false;
+        throw 42;
+    }
+}
+
+bool Evaluator::compare(Operator op, const Value & l, const Value & r)
+{
+    auto left = l.number();
+    auto right = r.number();
+    if (left && right)
+    {
+        switch (op)
+        {
+        case Operator::Equal:
+            return *left == *right;
+        case Operator::NotEqual:
+            return *left != *right;
+        case Operator::GreaterThan:
+            return *left > *right;
+        case Operator::LowerThan:
+            return *left < *right;
+        case Operator::GreaterOrEqual:
+            return *left >= *right;
+        case Operator::LowerOrEqual:
+            return *left <= *right;
+        }
+    }
+
+    switch (op)
+    {
+    case Operator::Equal:
+        return l == r;
+    case Operator::NotEqual:
+        return l != r;
+    case Operator::GreaterOrEqual:
+        return l >= r;
+    case Operator::GreaterThan:
+        return l > r;
+    case Operator::LowerOrEqual:
+        return l <= r;
+    case Operator::LowerThan:
+        return l < r;
     }
+
+    return false;
 }
 
 bool Evaluator::isParameterSeparator(Token::Type type)
@@ -837,6 +1845,7 @@ bool Evaluator::isNegated()
 
 void Evaluator::let()
 {
+    auto variableIndex = pc;
     auto tok = tokens[pc++];
     std::string variableName;
     int arrayIndex = -1;
@@ -849,8 +1858,7 @@ void Evaluator::let()
         break;
     }
     default:
-        std::cerr << "Unexpected token " << tok << ", expecting a variable after 'let' on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, ", expecting a variable after 'let' on line ", tok.line, '\n');
     }
 
     setPronoun(variableName);
@@ -862,51 +1870,54 @@ void Evaluator::let()
         auto res = evaluateExpression();
         if (!res.isDouble())
         {
-            std::cerr << "Unexpected value " << res << ", expecting an number after 'at' on line " << tok.line << '\n';
-            std::exit(1);
+            throwScriptError("Unexpected value ", res, ", expecting an number after 'at' on line ", tok.line, '\n');
         }
 
         arrayIndex = static_cast<int>(res.asDouble());
 
         if (arrayIndex < 0)
         {
-            std::cerr << "Invalid index " << arrayIndex << ", expecting an positive number after 'at' on line " << tok.line << '\n';
-            std::exit(1);
+            throwScriptError("Invalid index ", arrayIndex, ", expecting an positive number after 'at' on line ", tok.line, '\n');
         }
     }
 
     if (tokens[pc++].type != Token::Type::Be)
     {
-        std::cerr << "Unexpected token " << tok << ", expecting 'be' after the variable on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, ", expecting 'be' after the variable on line ", tok.line, '\n');
     }
 
     if (tokens.size() > pc + 3 && (tokens[pc + 2].type == Token::Type::Comma || tokens[pc + 3].type == Token::Type::Comma))
     {
-        auto initialValue = tok;
+        auto initialValue = variableIndex;
         auto op = tokens[pc];
         bool hasValue = false;
         if (tokens[pc + 3].type == Token::Type::Comma)
         {
-            initialValue = tokens[pc];
+            initialValue = pc;
             op = tokens[pc + 1];
             hasValue = true;
         }
 
         pc += (hasValue ? 2 : 1);
 
-        std::vector<Token> result;
-        result.push_back(initialValue);
+        std::vector<Operand> result;
+        result.push_back(toOperand(tokens, initialValue));
 
         auto vals = evaluateList();
-        for (auto val : vals)
+        for (auto & val : vals)
         {
-            result.push_back(Token(val, tok.line));
-            result.push_back(op);
+            result.emplace_back(std::move(val));
+            result.emplace_back(op.type);
         }
 
-        auto res = calculate(result);
-        setVariable(variableName, res);
+        if (arrayIndex != -1)
+        {
+            setVariable(variableName, arrayIndex, calculate(result));
+        }
+        else
+        {
+            setVariable(variableName, calculate(result));
+        }
     }
     else
     {
@@ -914,11 +1925,11 @@ void Evaluator::let()
 
         if (arrayIndex != -1)
         {
-            setVariable(variableName, arrayIndex, res);
+            setVariable(variableName, arrayIndex, std::move(res));
         }
         else
         {
-            setVariable(variableName, res);
+            setVariable(variableName, std::move(res));
         }
     }
 }
@@ -939,25 +1950,22 @@ void Evaluator::put()
         break;
     }
     default:
-        std::cerr << "Unexpected token " << tok << " after 'put' on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, " after 'put' on line ", tok.line, '\n');
     }
 
     tok = tokens[pc++];
     if (tok.type != Token::Type::Into)
     {
-        std::cerr << "Unexpected token " << tok << ", expecting 'into' after the expression on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, ", expecting 'into' after the expression on line ", tok.line, '\n');
     }
 
     auto var = tokens[pc++];
     if (var.type != Token::Type::Variable)
     {
-        std::cerr << "Unexpected token " << tok << ", expecting a variable after 'into' on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, ", expecting a variable after 'into' on line ", tok.line, '\n');
     }
 
-    setVariable(var.value, value);
+    setVariable(var.value, std::move(value));
     setPronoun(var.value);
 }
 
@@ -967,11 +1975,10 @@ void Evaluator::build()
 
     if (tok.type != Token::Type::Variable && tok.type != Token::Type::Pronoun)
     {
-        std::cerr << "Unexpected token " << tok << ", expecting a variable after 'build' on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, ", expecting a variable after 'build' on line ", tok.line, '\n');
     }
 
-    auto name = (tok.type == Token::Type::Pronoun ? lastVariableNamed : tok.value);
+    auto name = (tok.type == Token::Type::Pronoun ? std::string_view(lastVariableNamed) : tok.value);
 
     int count = 0;
     do {
@@ -979,8 +1986,7 @@ void Evaluator::build()
         bool isComma = tok.type == Token::Type::Comma;
         if(tok.type != Token::Type::Up && !isComma)
         {
-            std::cerr << "Unexpected token " << tok << ", expecting 'up' after a variable or others 'up' on line " << tok.line << '\n';
-            std::exit(1);
+            throwScriptError("Unexpected token ", tok, ", expecting 'up' after a variable or others 'up' on line ", tok.line, '\n');
         }
 
         if (!isComma)
@@ -990,7 +1996,7 @@ void Evaluator::build()
     } while (pc < tokens.size());
 
 
-    auto v = variables[name];
+    const auto & v = localVariable(name);
     if (v.isDouble())
     {
         auto d = v.asDouble();
@@ -1008,8 +2014,7 @@ void Evaluator::build()
     }
     else
     {
-        std::cerr << "You can't increment a variable that is not a number or a boolean, on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("You can't increment a variable that is not a number or a boolean, on line ", tok.line, '\n');
     }
 
     pc--;
@@ -1021,8 +2026,7 @@ void Evaluator::knock()
 
     if(tok.type != Token::Type::Variable)
     {
-        std::cerr << "Unexpected token " << tok << ", expecting a variable after 'knock' on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, ", expecting a variable after 'knock' on line ", tok.line, '\n');
     }
 
     auto name = tok.value;
@@ -1033,8 +2037,7 @@ void Evaluator::knock()
         bool isComma = tok.type == Token::Type::Comma;
         if(tok.type != Token::Type::Down && !isComma)
         {
-            std::cerr << "Unexpected token " << tok << ", expecting 'down' after a variable or others 'down' on line " << tok.line << '\n';
-            std::exit(1);
+            throwScriptError("Unexpected token ", tok, ", expecting 'down' after a variable or others 'down' on line ", tok.line, '\n');
         }
 
         if (!isComma)
@@ -1043,7 +2046,7 @@ void Evaluator::knock()
         }
     } while (pc < tokens.size());
 
-    auto v = getVariable(name);
+    const auto & v = getVariable(name);
     if (v.isDouble())
     {
         auto d = v.asDouble();
@@ -1061,8 +2064,7 @@ void Evaluator::knock()
     }
     else
     {
-        std::cerr << "You can't decrement a variable that is not a number or a boolean, on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("You can't decrement a variable that is not a number or a boolean, on line ", tok.line, '\n');
     }
 
     pc--;
@@ -1075,11 +2077,10 @@ void Evaluator::rock()
 
     if(tok.type != Token::Type::Variable)
     {
-        std::cerr << "Unexpected token " << tok << ", expecting a variable after 'rock' on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, ", expecting a variable after 'rock' on line ", tok.line, '\n');
     }
 
-    auto & var = variables[tok.value];
+    auto & var = localVariable(tok.value);
     if (!var.isArray())
     {
         var = Value(Value::Special::Array);
@@ -1090,15 +2091,15 @@ void Evaluator::rock()
         pc++;
         auto values = evaluateList();
 
-        for (auto val : values)
+        for (auto & val : values)
         {
-            var.push(val);
+            var.push(std::move(val));
         }
     }
     else if (tokens[pc].type == Token::Type::Like)
     {
         tok = tokens[++pc];
-        var.push(Value(std::stod(tok.value)));
+        var.push(Value(toNumber(tok.value)));
         pc++;
     }
 }
@@ -1110,15 +2111,13 @@ Value Evaluator::roll()
 
     if (tok.type != Token::Type::Variable)
     {
-        std::cerr << "Unexpected token " << tok << ", expecting a variable after 'roll' on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, ", expecting a variable after 'roll' on line ", tok.line, '\n');
     }
 
-    auto & var = variables[tok.value];
+    auto & var = localVariable(tok.value);
     if (!var.isArray())
     {
-        std::cerr << "Can't roll from a " << var.type() << ", only from an array on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Can't roll from a ", var.type(), ", only from an array on line ", tok.line, '\n');
     }
 
     return var.pop();
@@ -1130,8 +2129,7 @@ Value Evaluator::turn()
 
     if (op.type != Token::Type::Up && op.type != Token::Type::Down)
     {
-        std::cerr << "Unexpected token " << op << ", expecting 'up' or 'down' after 'turn' on line " << op.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", op, ", expecting 'up' or 'down' after 'turn' on line ", op.line, '\n');
     }
 
     auto tok = tokens[pc++];
@@ -1139,15 +2137,13 @@ Value Evaluator::turn()
 
     if (tok.type != Token::Type::Variable)
     {
-        std::cerr << "Unexpected token " << tok << ", expecting a variable after 'turn " << op.value << "' on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, ", expecting a variable after 'turn ", op.value, "' on line ", tok.line, '\n');
     }
 
-    auto & var = variables[tok.value];
+    auto & var = localVariable(tok.value);
     if (!var.isDouble())
     {
-        std::cerr << "You can 'turn " << op.value << "' only a number, got a " << var.type() << ", on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("You can 'turn ", op.value, "' only a number, got a ", var.type(), ", on line ", tok.line, '\n');
     }
 
     auto d = var.asDouble();
@@ -1160,30 +2156,69 @@ Value Evaluator::turn()
         d = std::floor(d);
         break;
     default:
-        std::cerr << "Unexpected error. Got " << op << " instead of 'up' or 'down' on line " << op.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected error. Got ", op, " instead of 'up' or 'down' on line ", op.line, '\n');
     }
 
-    variables[tok.value] = Value(d);
+    localVariable(tok.value) = Value(d);
     return Value(d);
 }
 
-void Evaluator::setPronoun(std::string name)
+void Evaluator::listen()
+{
+    if (Input::standard().isReserved())
+    {
+        throwScriptError("Can't 'listen' while the script itself is read from stdin, on line ", tokens[pc - 1].line, '\n');
+    }
+
+    auto line = Input::standard().readLine();
+
+    if (pc >= tokens.size())
+    {
+        // a bare "listen" discards the line
+        return;
+    }
+
+    // 'to' is only a keyword here, elsewhere it can name a variable
+    auto tok = tokens[pc++];
+    if (tok.type != Token::Type::Variable || tok.value != "to")
+    {
+        throwScriptError("Unexpected token ", tok, ", expecting 'to' after 'listen' on line ", tok.line, '\n');
+    }
+
+    tok = tokens[pc++];
+    if (tok.type != Token::Type::Variable)
+    {
+        throwScriptError("Unexpected token ", tok, ", expecting a variable after 'listen to' on line ", tok.line, '\n');
+    }
+
+    if (line)
+    {
+        setVariable(tok.value, Value(std::string(*line)));
+    }
+    else
+    {
+        setVariable(tok.value, Value(Value::Special::Undefined));
+    }
+    setPronoun(tok.value);
+}
+
+void Evaluator::setPronoun(std::string_view name)
 {
     lastVariableNamed = name;
 }
 
-void Evaluator::startFunctionDeclaration(std::string name)
+void Evaluator::startFunctionDeclaration(std::string_view name)
 {
     isInFunction = name;
+    // a streamed program drops the lines it has run
+    functionStart = (stream ? NoLine : line);
 
     Function func;
 
     auto tok = tokens[pc++];
     if(tok.type != Token::Type::Variable)
     {
-        std::cerr << "Unexpected token " << tok << ", expecting a variable since a function requires at least one parameter on line " << tok.line << '\n';
-        std::exit(1);
+        throwScriptError("Unexpected token ", tok, ", expecting a variable since a function requires at least one parameter on line ", tok.line, '\n');
     }
     func.addParameter(tok.value);
 
@@ -1192,32 +2227,34 @@ void Evaluator::startFunctionDeclaration(std::string name)
         tok = tokens[pc++];
         if (!isParameterSeparator(tok.type))
         {
-            std::cerr << "Unexpected token " << tok << " on line " << tok.line << '\n';
-            std::exit(1);
+            throwScriptError("Unexpected token ", tok, " on line ", tok.line, '\n');
         }
 
         tok = tokens[pc++];
         if(tok.type != Token::Type::Variable)
         {
-            std::cerr << "Unexpected token " << tok << ", function expects variable as parameters on line " << tok.line << '\n';
-            std::exit(1);
+            throwScriptError("Unexpected token ", tok, ", function expects variable as parameters on line ", tok.line, '\n');
         }
         func.addParameter(tok.value);
     }
 
-    functions[name] = func;
+    functions.insert_or_assign(std::string(name), std::move(func));
+    // reads of the name now call the function
+    generation++;
+    Function::declared(parent != nullptr);
 }
 
-Value Evaluator::executeFunction(std::string name)
+Value Evaluator::executeFunction(std::string_view name)
 {
     auto & func = getFunction(name);
-    Array arguments;
+
+    // nested calls in the arguments keep theirs above these
+    auto base = arguments.size();
     for (int i = 0; i < func.args(); i++)
     {
-        auto t = tokens[pc].type;
         arguments.push_back(evaluateExpression(false));
 
-        t = tokens[pc++].type;
+        auto t = tokens[pc++].type;
         switch (t)
         {
         C(Comma):
@@ -1231,7 +2268,36 @@ Value Evaluator::executeFunction(std::string name)
         }
     }
 
-    return func.call(this, arguments);
+    if (auto body = func.inlined())
+    {
+        // calculated without a scope of its own, it can't name the pronoun
+        auto operandsBase = operands.size();
+        for (const auto & term : *body)
+        {
+            if (term.parameter >= 0)
+            {
+                operands.emplace_back(arguments[base + term.parameter]);
+            }
+            else if (term.op != Token::Type::EndOfFile)
+            {
+                operands.emplace_back(term.op);
+            }
+            else
+            {
+                operands.emplace_back(term.value);
+            }
+        }
+        arguments.erase(arguments.begin() + base, arguments.end());
+
+        auto result = calculate(std::span(operands).subspan(operandsBase));
+        operands.erase(operands.begin() + operandsBase, operands.end());
+        return result;
+    }
+
+    // the callee runs in its own evaluator, these stay where they are until it returns
+    auto result = func.call(this, std::span(arguments).subspan(base));
+    arguments.erase(arguments.begin() + base, arguments.end());
+    return result;
 }
 
 Operator Evaluator::checkOperator()
@@ -1253,15 +2319,13 @@ Operator Evaluator::checkOperator()
             opType = Operator::LowerOrEqual;
             break;
         default:
-            std::cerr << "Unexpected token " << op2 << " after 'as' on line " << op2.line << '\n';
-            std::exit(1);
+            throwScriptError("Unexpected token ", op2, " after 'as' on line ", op2.line, '\n');
         }
 
         auto secondAs = tokens[++pc];
         if (secondAs.type != Token::Type::As)
         {
-            std::cerr << "Unexpected token " << secondAs << ", expecting 'as' after '" << op2 << "' on line " << op2.line << '\n';
-            std::exit(1);
+            throwScriptError("Unexpected token ", secondAs, ", expecting 'as' after '", op2, "' on line ", op2.line, '\n');
         }
     }
     else if (op == Token::Type::Not)
@@ -1277,8 +2341,7 @@ Operator Evaluator::checkOperator()
         auto secondAs = tokens[++pc];
         if (secondAs.type != Token::Type::Than)
         {
-            std::cerr << "Unexpected token " << secondAs << ", expecting 'than' on line " << secondAs.line << '\n';
-            std::exit(1);
+            throwScriptError("Unexpected token ", secondAs, ", expecting 'than' on line ", secondAs.line, '\n');
         }
     }
 
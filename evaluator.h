@@ -3,10 +3,24 @@
 
 #include "token.h"
 #include "value.h"
+#include <functional>
+#include <string_view>
 #include <vector>
+#include <optional>
+#include <span>
 #include <stack>
 #include <unordered_map>
 #include "function.h"
+#include "tokenstore.h"
+
+class LineQueue;
+
+// lets the maps be searched with a std::string_view, without making a std::string
+struct StringHash
+{
+    using is_transparent = void;
+    size_t operator()(std::string_view text) const;
+};
 
 enum class Operator {
     Equal,
@@ -17,48 +31,213 @@ enum class Operator {
     LowerOrEqual,
 };
 
+// an element of an expression in postfix order: a value already known,
+// a variable read when the expression is calculated, or an operator
+class Operand
+{
+public:
+    enum class Kind {
+        Value,
+        Variable,
+        Operator,
+    };
+
+    // a variable not read from the program, that can't keep what it resolved to
+    static constexpr uint32_t NoSite = -1;
+
+    explicit Operand(Value value);
+    explicit Operand(std::string_view variable, uint32_t site = NoSite);
+    explicit Operand(Token::Type op);
+
+    Kind kind;
+    Token::Type op = Token::Type::EndOfFile;
+    std::string_view variable;
+    // position of the variable in the program
+    uint32_t site = NoSite;
+    Value value;
+};
+
 class Evaluator
 {
 public:
-    Evaluator(std::vector<Token> tokens);
+    // a function body runs with its caller as parent, without one the
+    // program is a session's, which more lines may be appended to
+    Evaluator(const std::vector<Token> & tokens, Evaluator * parent = nullptr);
+    // a whole program, already split in lines
+    explicit Evaluator(TokenStore program);
+
+    // runs lines as they come out of the queue
+    explicit Evaluator(LineQueue & queue);
+
+    // runs the program again from its start, for another call of a function,
+    // keeping the lines prepared
+    void restart(Evaluator * parent);
 
-    void setParent(Evaluator * evaluator);
+    // adds code to run at the next eval(), keeping variables and functions
+    void append(const std::vector<Token> & tokens);
+    bool isStreaming() const;
 
-    bool setVariable(std::string name, Value value, bool setIfNotExisting = true);
-    bool setVariable(std::string name, int index, Value value);
+    void setVariable(std::string_view name, Value value);
+    bool setVariable(std::string_view name, int index, Value value);
     Value eval();
 
-    Value getVariable(std::string name);
-    Function & getFunction(std::string name);
-    bool hasFunction(std::string name);
+    const Value & getVariable(std::string_view name) const;
+    const Value & readVariable(const Operand & operand);
+    Function & getFunction(std::string_view name);
+    bool hasFunction(std::string_view name) const;
 
 private:
-    std::vector<std::vector<Token>> lines;
+    TokenStore program;
     size_t line = 0;
-    std::vector<Token> tokens;
+    TokenStore::Line tokens;
     size_t pc = 0;
     std::string lastVariableNamed;
     std::string isInFunction;
+    // the first line of the body being declared, NoLine when its tokens are copied
+    size_t functionStart = 0;
     std::stack<Token::Type> nextEmptyLine;
     std::stack<size_t> loops;
+    // kept from one expression to the next to reuse their memory
+    std::vector<Operand> operands;
+    std::vector<Token::Type> operators;
+    std::vector<Value> calculation;
+    // the arguments of the calls being made
+    std::vector<Value> arguments;
+
+    // what each variable read of the program resolved to, a function or a
+    // variable, valid while its generation is the current one
+    struct Binding {
+        uint32_t generation = 0;
+        const Value * variable = nullptr;
+    };
+    std::vector<Binding> bindings;
+    // changes when a function or a variable is declared, or the program is replaced
+    uint32_t generation = 1;
+
+    // for each token, the first one after it that can't continue an
+    // expression, or the last token of its line
+    std::vector<uint32_t> expressionEnds;
+    size_t preparedLines = 0;
+
+    // for each line opening a block, the line to go on with once it is left
+    static constexpr size_t NoLine = -1;
+    std::vector<size_t> blockExits;
+    std::vector<size_t> openBlocks;
+    // where preparing starts again when lines are appended: the outermost
+    // block the end of file closed, or else the end of file
+    size_t reopenFrom = 0;
+
+    // for each line, what a plain "Build X up, up" or "Knock X down" adds,
+    // and the variable it changed last
+    struct Step {
+        int count = 0;
+        uint32_t generation = 0;
+        Value * variable = nullptr;
+    };
+    std::vector<Step> steps;
+    static int stepCount(const TokenStore::Line & tokens);
+    void step(Step & step);
+
+    // loops testing a variable against a single operand, by line
+    struct LoopTest {
+        Operand variable;
+        Operator op;
+        bool negate;
+        Operand other;
+    };
+    std::unordered_map<size_t, LoopTest> loopTests;
+    std::optional<LoopTest> loopTest(const TokenStore::Line & tokens);
+
+    // constant expressions calculated when their line is prepared: for each
+    // token starting one, its index in constants plus one
+    struct Constant {
+        Value value;
+        uint32_t last;
+    };
+    std::vector<Constant> constants;
+    std::vector<uint32_t> folded;
+    // the whole program is known, variables set once to a constant can be replaced by it
+    bool wholeProgram = false;
+    using Known = std::unordered_map<std::string_view, Value>;
+    void foldLine(const TokenStore::Line & tokens, const Known & known);
+    // lines of function declarations, which this evaluator doesn't run
+    std::vector<bool> declarationLines();
+    void foldConstants(const std::vector<bool> & declarations);
+    size_t arithmeticRun(const TokenStore::Line & tokens, size_t first, const std::function<bool(std::string_view)> & isValue);
+    Value calculateRun(const TokenStore::Line & tokens, size_t first, size_t last, const Known & known);
+    void pushRun(const TokenStore::Line & tokens, size_t first, size_t last, const Known & known);
+
+    // expressions of a loop over variables it doesn't change, kept from
+    // their first use until the loop is left: for each token starting one,
+    // its index in invariants plus one
+    struct Invariant {
+        Value value;
+        uint32_t last;
+        size_t head;
+        // the entry in the loop the value was calculated in
+        uint32_t entry;
+    };
+    std::vector<Invariant> invariants;
+    std::vector<uint32_t> hoisted;
+    // how many times each loop was entered, its head being run again doesn't count
+    std::vector<uint32_t> loopEntries;
+    bool repeating = false;
+    void hoistInvariants(size_t head, size_t end);
+
+    // arithmetic on variables only ever given numbers, calculated on doubles
+    // as long as they hold one: for each token starting it, its index in
+    // numericRuns plus one
+    enum class Type {
+        Unset,
+        Number,
+        Unknown,
+    };
+    struct NumericTerm {
+        static constexpr uint32_t NoVariable = -1;
+
+        // EndOfFile for a number or a variable
+        Token::Type op;
+        double number = 0;
+        uint32_t variable = NoVariable;
+    };
+    struct NumericRun {
+        std::vector<NumericTerm> terms;
+        std::vector<Operand> variables;
+        uint32_t last;
+    };
+    static constexpr size_t MaxNumericRun = 31;
+    std::vector<NumericRun> numericRuns;
+    std::vector<uint32_t> numeric;
+    void inferTypes(const std::vector<bool> & declarations);
+    bool calculateNumbers(const NumericRun & run, double & result);
+
+    // called when lines are added to the program
+    void prepareLines();
     Evaluator * parent = nullptr;
+    LineQueue * stream = nullptr;
+
+    bool fetchLines();
+
+    // the variable of this scope, created if needed
+    Value & localVariable(std::string_view name);
 
-    void parseVariable(std::string name);
-    void parsePoeticNumberVariable(std::string name);
-    void parsePoeticStringVariable(std::string name);
-    Value evaluateExpression(bool greedy = true, std::string variable = {});
+    void parseVariable(std::string_view name);
+    void parsePoeticNumberVariable(std::string_view name);
+    void parsePoeticStringVariable(std::string_view name);
+    Value evaluateExpression(bool greedy = true, std::string_view variable = {});
     Array evaluateList();
-    Value calculate(std::vector<Token> result);
-    bool isExpressionToken(Token::Type type, bool keepIs);
+    Value calculate(std::span<const Operand> expression);
+    Operand toOperand(const TokenStore::Line & tokens, size_t index);
+    static bool compare(Operator op, const Value & l, const Value & r);
     bool isParameterSeparator(Token::Type type);
     bool isConditional(Token::Type type);
     bool isNegated();
-    void setPronoun(std::string name);
-    void startFunctionDeclaration(std::string name);
-    Value executeFunction(std::string name);
+    void setPronoun(std::string_view name);
+    void startFunctionDeclaration(std::string_view name);
+    Value executeFunction(std::string_view name);
     Operator checkOperator();
 
-    std::unordered_map<std::string, Function> functions;
+    std::unordered_map<std::string, Function, StringHash, std::equal_to<>> functions;
 
     void let();
     void put();
@@ -67,8 +246,11 @@ private:
     void rock();
     Value roll();
     Value turn();
+    void listen();
 
-    std::unordered_map<std::string, Value> variables;
+    std::unordered_map<std::string, Value, StringHash, std::equal_to<>> variables;
+    // the variables of a previous call, reused with their memory by the next one
+    std::vector<decltype(variables)::node_type> spareVariables;
 };
 
 #endif // EVALUATOR_H
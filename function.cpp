@@ -1,13 +1,57 @@
 #include "function.h"
 #include "evaluator.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_set>
+
+#define C(c) case Token::Type::c
+
+static bool memoizing = false;
+static uint32_t declarations = 1;
+static bool declaredInFunction = false;
 
 Function::Function()
 {
 }
 
+Function::Function(Function &&) = default;
+Function & Function::operator=(Function &&) = default;
+Function::~Function() = default;
+
 void Function::addToken(Token token)
 {
-    tokens.push_back(token);
+    tokens.push_back(std::move(token));
+}
+
+void Function::setSource(const TokenStore & program, size_t firstLine, size_t endLine)
+{
+    source = &program;
+    this->firstLine = firstLine;
+    this->endLine = endLine;
+}
+
+void Function::load()
+{
+    if (!source)
+    {
+        return;
+    }
+
+    // as Evaluator::eval() records a body while streaming
+    for (auto l = firstLine; l < endLine; l++)
+    {
+        auto line = source->getLine(l);
+        for (size_t i = 0; i < line.size(); i++)
+        {
+            auto t = line[i];
+            tokens.emplace_back(t.type, std::string(t.value), t.line);
+        }
+        if (line.front().type != Token::Type::NewLine)
+        {
+            tokens.emplace_back(Token::Type::NewLine, "", line.front().line);
+        }
+    }
+    source = nullptr;
 }
 
 int Function::args() const
@@ -15,19 +59,380 @@ int Function::args() const
     return parameters.size();
 }
 
-void Function::addParameter(std::string name)
+void Function::addParameter(std::string_view name)
 {
-    parameters.push_back(name);
+    parameters.emplace_back(name);
 }
-#include <iostream>
-Value Function::call(Evaluator * parent, Array arguments)
+
+Value Function::call(Evaluator * parent, std::span<Value> arguments)
+{
+    load();
+
+    std::string key;
+    bool memoized = memoizing && isPure(*parent) && memoKey(arguments, key);
+    if (memoized)
+    {
+        if (auto found = resultIndex.find(key); found != resultIndex.end())
+        {
+            results.splice(results.begin(), results, found->second);
+            return found->second->second;
+        }
+    }
+
+    auto result = run(parent, arguments);
+
+    // a recursive call with the same arguments may have kept it already
+    if (memoized && !resultIndex.contains(key))
+    {
+        results.emplace_front(std::move(key), result);
+        resultIndex.emplace(results.front().first, results.begin());
+        if (results.size() > MemoLimit)
+        {
+            resultIndex.erase(results.back().first);
+            results.pop_back();
+        }
+    }
+
+    return result;
+}
+
+Value Function::run(Evaluator * parent, std::span<Value> arguments)
 {
-    Evaluator evaluator(tokens);
-    evaluator.setParent(parent);
+    // the code was made knowing which names are functions, a declaration
+    // since then may have changed that, one in a body makes it depend on the caller
+    if (calls == JitThreshold && (compiledAt != declarations || declaredInFunction))
+    {
+        native.reset();
+        calls = 0;
+    }
+
+    if (Jit::isEnabled() && !declaredInFunction && calls < JitThreshold && ++calls == JitThreshold)
+    {
+        native = Jit(parameters, tokens, *parent).compile();
+        compiledAt = declarations;
+    }
+
+    Value result;
+    if (native && native->call(arguments, result))
+    {
+        return result;
+    }
+
+    std::unique_ptr<Evaluator> evaluator;
+    if (idle.size())
+    {
+        evaluator = std::move(idle.back());
+        idle.pop_back();
+        evaluator->restart(parent);
+    }
+    else
+    {
+        evaluator = std::make_unique<Evaluator>(tokens, parent);
+    }
+
     for (size_t i = 0; i < parameters.size(); i++)
     {
-        evaluator.setVariable(parameters[i], arguments[i]);
+        evaluator->setVariable(parameters[i], std::move(arguments[i]));
+    }
+    result = evaluator->eval();
+
+    if (idle.size() < MaxIdle)
+    {
+        idle.push_back(std::move(evaluator));
+    }
+    return result;
+}
+
+void Function::enableMemoization()
+{
+    memoizing = true;
+}
+
+void Function::declared(bool inFunction)
+{
+    declarations++;
+    // functions declared in a body are only seen by the calls under it,
+    // what a function calls then depends on its caller
+    declaredInFunction |= inFunction;
+}
+
+bool Function::isPure(Evaluator & caller)
+{
+    if (declaredInFunction)
+    {
+        return false;
+    }
+    if (checkedAt == declarations)
+    {
+        return pure;
+    }
+
+    checkedAt = declarations;
+    results.clear();
+    resultIndex.clear();
+
+    // every function it can reach has a pure body
+    std::vector<Function *> pending { this };
+    std::unordered_set<const Function *> seen { this };
+    pure = true;
+    while (pure && pending.size())
+    {
+        auto function = pending.back();
+        pending.pop_back();
+
+        std::vector<std::string_view> callees;
+        pure = function->hasPureBody(caller, callees);
+        for (auto name : callees)
+        {
+            auto & callee = caller.getFunction(name);
+            if (seen.insert(&callee).second)
+            {
+                pending.push_back(&callee);
+            }
+        }
+    }
+
+    return pure;
+}
+
+bool Function::hasPureBody(Evaluator & caller, std::vector<std::string_view> & callees)
+{
+    load();
+    std::unordered_set<std::string_view> locals(parameters.begin(), parameters.end());
+    int depth = 0;
+    size_t start = 0;
+    for (size_t i = 0; i < tokens.size(); i++)
+    {
+        const auto & tok = tokens[i];
+        auto previous = (i > start ? tokens[i - 1].type : Token::Type::NewLine);
+        auto next = (i + 1 < tokens.size() ? tokens[i + 1].type : Token::Type::NewLine);
+
+        // the variable is named again after it on its line
+        auto isReadAgain = [&]() {
+            for (auto j = i + 1; j < tokens.size() && tokens[j].type != Token::Type::NewLine; j++)
+            {
+                if (tokens[j].type == Token::Type::Variable && tokens[j].value == tok.value)
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        switch (tok.type)
+        {
+        C(Shout):
+        C(Whisper):
+        C(Listen):
+        C(Takes):
+            return false;
+        C(NewLine):
+            // an empty line closes a block
+            if (i == start && depth > 0)
+            {
+                depth--;
+            }
+            start = i + 1;
+            break;
+        C(If):
+        C(While):
+        C(Until):
+            if (i == start)
+            {
+                depth++;
+            }
+            break;
+        C(Variable):
+        {
+            if (caller.hasFunction(tok.value))
+            {
+                if (next == Token::Type::Taking)
+                {
+                    callees.push_back(tok.value);
+                }
+                break;
+            }
+            if (locals.contains(tok.value))
+            {
+                break;
+            }
+
+            // a variable of its own, set outside of any block before being read,
+            // others are the caller's
+            bool isSet = (previous == Token::Type::Let && next == Token::Type::Be && !isReadAgain())
+                || (previous == Token::Type::Rock && !isReadAgain())
+                || previous == Token::Type::Into
+                || (i == start && (next == Token::Type::Is || next == Token::Type::Says));
+            if (depth || !isSet)
+            {
+                return false;
+            }
+            locals.insert(tok.value);
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool Function::memoKey(std::span<const Value> arguments, std::string & key)
+{
+    for (const auto & argument : arguments)
+    {
+        if (argument.isDouble())
+        {
+            auto number = argument.asDouble();
+            char bytes[sizeof(number)];
+            std::memcpy(bytes, &number, sizeof(number));
+            key += 'd';
+            key.append(bytes, sizeof(bytes));
+        }
+        else if (argument.isBool())
+        {
+            key += (argument.asBool() ? 't' : 'f');
+        }
+        else if (argument.isString())
+        {
+            auto text = argument.asString();
+            key += 's';
+            key += std::to_string(text.size());
+            key += ':';
+            key += text;
+        }
+        else if (argument.isNull())
+        {
+            key += 'n';
+        }
+        else if (argument.isUndefined())
+        {
+            key += 'u';
+        }
+        else
+        {
+            // arrays aren't kept
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const std::vector<Function::Term> * Function::inlined()
+{
+    if (!inlineChecked)
+    {
+        load();
+        inlineChecked = true;
+        isInlined = inlineBody();
+    }
+
+    return isInlined ? &body : nullptr;
+}
+
+bool Function::inlineBody()
+{
+    // "Give back" and values joined by arithmetic, then only the end of the body
+    if (tokens.size() < 2 || tokens[0].type != Token::Type::Give)
+    {
+        return false;
+    }
+    size_t first = (tokens[1].type == Token::Type::Back ? 2 : 1);
+
+    auto last = first;
+    while (last < tokens.size() && tokens[last].type != Token::Type::NewLine && tokens[last].type != Token::Type::EndOfFile)
+    {
+        last++;
+    }
+    if (last == first || last - first > InlineLimit)
+    {
+        return false;
+    }
+    for (auto i = last; i < tokens.size(); i++)
+    {
+        if (tokens[i].type != Token::Type::NewLine && tokens[i].type != Token::Type::EndOfFile)
+        {
+            return false;
+        }
+    }
+
+    // the postfix order of Evaluator::evaluateExpression()
+    std::vector<Term> terms;
+    std::vector<Token::Type> operators;
+    for (auto i = first; i < last; i++)
+    {
+        const auto & tok = tokens[i];
+        if ((i - first) % 2)
+        {
+            switch (tok.type)
+            {
+            C(Plus):
+            C(Minus):
+                while (operators.size())
+                {
+                    terms.push_back(Term(operators.back()));
+                    operators.pop_back();
+                }
+                [[fallthrough]];
+            C(Times):
+            C(Over):
+                operators.push_back(tok.type);
+                continue;
+            default:
+                return false;
+            }
+        }
+
+        Term term;
+        switch (tok.type)
+        {
+        C(Variable):
+        {
+            // a parameter named twice gets the last argument, other
+            // variables are the caller's ones, left to a real call
+            auto parameter = std::find(parameters.rbegin(), parameters.rend(), tok.value);
+            if (parameter == parameters.rend())
+            {
+                return false;
+            }
+            term.parameter = parameters.rend() - parameter - 1;
+            break;
+        }
+        C(Number):
+            term.value = Value(toNumber(tok.value));
+            break;
+        C(String):
+            term.value = Value(tok.value);
+            break;
+        C(True):
+            term.value = Value(true);
+            break;
+        C(False):
+            term.value = Value(false);
+            break;
+        C(Null):
+            break;
+        C(Mysterious):
+            term.value = Value(Value::Special::Undefined);
+            break;
+        default:
+            return false;
+        }
+        terms.push_back(std::move(term));
+    }
+    if ((last - first) % 2 == 0)
+    {
+        // it ends on an operator
+        return false;
+    }
+    while (operators.size())
+    {
+        terms.push_back(Term(operators.back()));
+        operators.pop_back();
     }
 
-    return evaluator.eval();
+    body = std::move(terms);
+    return true;
 }
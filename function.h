@@ -2,6 +2,14 @@
 #define FUNCTION_H
 
 #include "token.h"
+#include "tokenstore.h"
+#include "jit.h"
+#include <list>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 class Evaluator;
@@ -9,15 +17,79 @@ class Function
 {
 public:
     Function();
+    Function(Function &&);
+    Function & operator=(Function &&);
+    ~Function();
 
     void addToken(Token token);
+    // the lines of the body, copied at the first call, the store must outlive the function
+    void setSource(const TokenStore & program, size_t firstLine, size_t endLine);
     int args() const;
-    void addParameter(std::string name);
-    Value call(Evaluator * parent, Array arguments);
+    void addParameter(std::string_view name);
+    // the arguments are moved into the variables of the call
+    Value call(Evaluator * parent, std::span<Value> arguments);
+
+    // an element of a body that callers can calculate themselves, in
+    // postfix order: an operator, a parameter or a literal
+    struct Term {
+        Term() = default;
+        explicit Term(Token::Type op) : op(op) {}
+
+        Token::Type op = Token::Type::EndOfFile;
+        int parameter = -1;
+        Value value;
+    };
+
+    // null unless the body only gives back arithmetic on the parameters
+    // and literals, short enough to be calculated in place of a call
+    const std::vector<Term> * inlined();
+
+    // keeps the results of pure functions by their arguments
+    static void enableMemoization();
+    // called for every declaration, which may change what a function calls
+    static void declared(bool inFunction);
 
 private:
     std::vector<std::string> parameters;
     std::vector<Token> tokens;
+    const TokenStore * source = nullptr;
+    size_t firstLine = 0;
+    size_t endLine = 0;
+    void load();
+
+    // evaluators of the body prepared by previous calls, a recursive call
+    // takes another one
+    static constexpr size_t MaxIdle = 64;
+    std::vector<std::unique_ptr<Evaluator>> idle;
+
+    // calls before trying to run the function as machine code
+    static constexpr int JitThreshold = 100;
+    int calls = 0;
+    std::unique_ptr<NativeFunction> native;
+    // the count of declarations the function was compiled at
+    uint32_t compiledAt = 0;
+
+    static constexpr size_t InlineLimit = 15;
+    bool inlineChecked = false;
+    bool isInlined = false;
+    std::vector<Term> body;
+    bool inlineBody();
+
+    Value run(Evaluator * parent, std::span<Value> arguments);
+
+    // no output, input or change to the caller's variables, and only calls
+    // to functions that are pure too
+    bool isPure(Evaluator & caller);
+    bool hasPureBody(Evaluator & caller, std::vector<std::string_view> & callees);
+    static bool memoKey(std::span<const Value> arguments, std::string & key);
+
+    // the most recently used result first, past the limit the last one is dropped
+    static constexpr size_t MemoLimit = 10000;
+    std::list<std::pair<std::string, Value>> results;
+    std::unordered_map<std::string_view, decltype(results)::iterator> resultIndex;
+    // the count of declarations the purity was checked at
+    uint32_t checkedAt = 0;
+    bool pure = false;
 };
 
 #endif // FUNCTION_H
@@ -0,0 +1,147 @@
+#include "grammar.h"
+
+#define C(c) case Token::Type::c
+
+bool isExpressionToken(Token::Type type, bool greedy)
+{
+    switch (type)
+    {
+    C(Number):
+    C(Variable):
+    C(String):
+    C(True):
+    C(False):
+    C(Null):
+    C(Pronoun):
+    C(Mysterious):
+        return true;
+    C(Plus):
+    C(Minus):
+    C(Times):
+    C(Over):
+    C(Taking):
+    C(At):
+    C(Roll):
+    C(Turn):
+    C(And):
+    C(Or):
+    C(Not):
+    C(Is):
+    C(Isnt):
+        return greedy;
+    default:
+        return false;
+    }
+}
+
+bool isLiteral(Token::Type type)
+{
+    switch (type)
+    {
+    C(Number):
+    C(String):
+    C(True):
+    C(False):
+    C(Null):
+    C(Mysterious):
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool isArithmetic(Token::Type type)
+{
+    switch (type)
+    {
+    C(Plus):
+    C(Minus):
+    C(Times):
+    C(Over):
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool opensBlock(const TokenStore::Line & tokens)
+{
+    switch (tokens.front().type)
+    {
+    C(If):
+    C(While):
+    C(Until):
+        return true;
+    default:
+        // function declaration
+        return tokens[1].type == Token::Type::Takes;
+    }
+}
+
+bool isFunctionDeclaration(const TokenStore::Line & tokens)
+{
+    return tokens.front().type == Token::Type::Variable && tokens[1].type == Token::Type::Takes;
+}
+
+size_t bodyEnd(const TokenStore & program, size_t firstLine)
+{
+    int depth = 0;
+    for (auto end = firstLine; ; end++)
+    {
+        switch (program.getLine(end).front().type)
+        {
+        C(EndOfFile):
+            return end;
+        C(NewLine):
+            if (depth == 0)
+            {
+                return end;
+            }
+            depth--;
+            break;
+        C(If):
+        C(While):
+        C(Until):
+            depth++;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+bool isTakeItToTheTop(const TokenStore::Line & tokens)
+{
+    return tokens.size() == 4 && tokens[0].type == Token::Type::Variable && tokens[0].value == "take"
+        && tokens[1].type == Token::Type::Pronoun && tokens[2].type == Token::Type::Variable && tokens[2].value == "to"
+        && tokens[3].type == Token::Type::Variable && tokens[3].value == "the top";
+}
+
+bool isWritten(const TokenStore::Line & tokens, size_t index)
+{
+    if (tokens[index].type != Token::Type::Variable)
+    {
+        return false;
+    }
+
+    switch (index ? tokens[index - 1].type : Token::Type::NewLine)
+    {
+    C(Let):
+    C(Into):
+    C(Build):
+    C(Knock):
+    C(Rock):
+    C(Roll):
+    C(Up):
+    C(Down):
+        return true;
+    C(Variable):
+        // "listen to X", where 'to' is just a word
+        return index == 2 && tokens.front().type == Token::Type::Listen && tokens[1].value == "to";
+    C(NewLine):
+        // poetic assignments
+        return tokens[1].type == Token::Type::Is || tokens[1].type == Token::Type::Says;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef GRAMMAR_H
+#define GRAMMAR_H
+
+#include "token.h"
+#include "tokenstore.h"
+
+// how a program is structured, shared by the evaluator and the C++
+// backend so that both read a script the same way
+
+// tokens that go on with an expression, greedy ones also take operators
+bool isExpressionToken(Token::Type type, bool greedy);
+bool isLiteral(Token::Type type);
+bool isArithmetic(Token::Type type);
+
+// an 'if', a loop or a function declaration, closed by an empty line
+bool opensBlock(const TokenStore::Line & tokens);
+bool isFunctionDeclaration(const TokenStore::Line & tokens);
+// the line closing the body of a function declared just before firstLine:
+// the empty line closing none of its blocks, or the end of file
+size_t bodyEnd(const TokenStore & program, size_t firstLine);
+
+// "take it to the top", whose words stay plain so they can still name variables
+bool isTakeItToTheTop(const TokenStore::Line & tokens);
+
+// the variable at index is assigned by its statement
+bool isWritten(const TokenStore::Line & tokens, size_t index);
+
+#endif // GRAMMAR_H
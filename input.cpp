@@ -0,0 +1,96 @@
+#include "input.h"
+#include "output.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+static constexpr size_t BufferSize = 1 << 20;
+
+Input::Input(int fd)
+    : fd { fd }, buffer(BufferSize)
+{
+}
+
+Input & Input::standard()
+{
+    static Input in(STDIN_FILENO);
+    return in;
+}
+
+std::optional<std::string_view> Input::readLine()
+{
+    while (true)
+    {
+        auto from = buffer.data() + searched;
+        auto newline = static_cast<char *>(std::memchr(from, '\n', end - searched));
+
+        if (newline || (eof && start < end))
+        {
+            auto lineEnd = newline ? static_cast<size_t>(newline - buffer.data()) : end;
+            std::string_view line { buffer.data() + start, lineEnd - start };
+
+            start = searched = (newline ? lineEnd + 1 : end);
+
+            if (line.ends_with('\r')) line.remove_suffix(1);
+            return line;
+        }
+
+        if (eof || !fill())
+        {
+            return std::nullopt;
+        }
+    }
+}
+
+void Input::reserve()
+{
+    reserved = true;
+}
+
+bool Input::isReserved() const
+{
+    return reserved;
+}
+
+bool Input::fill()
+{
+    // everything before start has already been handed out
+    if (start > 0)
+    {
+        std::memmove(buffer.data(), buffer.data() + start, end - start);
+        end -= start;
+        start = 0;
+    }
+    searched = end;
+
+    if (end == buffer.size())
+    {
+        buffer.resize(buffer.size() * 2);
+    }
+
+    // whatever has been shouted must be visible before we wait for the user
+    Output::standard().flush();
+
+    while (true)
+    {
+        auto count = read(fd, buffer.data() + end, buffer.size() - end);
+        if (count < 0)
+        {
+            if (errno == EINTR) continue;
+
+            std::cerr << "Can't read input: " << std::strerror(errno) << '\n';
+            eof = true;
+        }
+        else if (count == 0)
+        {
+            eof = true;
+        }
+        else
+        {
+            end += count;
+        }
+
+        return !eof || start < end;
+    }
+}
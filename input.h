@@ -0,0 +1,34 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <optional>
+#include <string_view>
+#include <vector>
+
+class Input
+{
+public:
+    explicit Input(int fd);
+
+    static Input & standard();
+
+    // the returned view is only valid until the next call
+    std::optional<std::string_view> readLine();
+
+    // the fd is read by something else, the script can't listen to it
+    void reserve();
+    bool isReserved() const;
+
+private:
+    bool fill();
+
+    int fd;
+    std::vector<char> buffer;
+    size_t start = 0;
+    size_t end = 0;
+    size_t searched = 0;
+    bool eof = false;
+    bool reserved = false;
+};
+
+#endif // INPUT_H
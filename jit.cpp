@@ -0,0 +1,777 @@
+#include "jit.h"
+#include <bit>
+#include <cstring>
+#include <sys/mman.h>
+#include "evaluator.h"
+#include "grammar.h"
+
+#define C(c) case Token::Type::c
+
+static bool enabled = false;
+
+NativeFunction::NativeFunction(const std::vector<uint8_t> & code, std::vector<int> parameterSlots)
+    : parameterSlots(std::move(parameterSlots))
+{
+    void * block = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (block == MAP_FAILED)
+    {
+        return;
+    }
+
+    std::memcpy(block, code.data(), code.size());
+    if (mprotect(block, code.size(), PROT_READ | PROT_EXEC) != 0)
+    {
+        munmap(block, code.size());
+        return;
+    }
+
+    memory = block;
+    size = code.size();
+}
+
+NativeFunction::~NativeFunction()
+{
+    if (memory)
+    {
+        munmap(memory, size);
+    }
+}
+
+bool NativeFunction::call(std::span<const Value> arguments, Value & result) const
+{
+    if (!memory)
+    {
+        return false;
+    }
+
+    double values[MaxSlots];
+    for (size_t i = 0; i < parameterSlots.size(); i++)
+    {
+        if (!arguments[i].isDouble())
+        {
+            return false;
+        }
+        values[parameterSlots[i]] = arguments[i].asDouble();
+    }
+
+    double number = 0;
+    switch (reinterpret_cast<Entry>(memory)(values, &number))
+    {
+    case 1:
+        result = Value(number);
+        break;
+    case 2:
+        result = Value(number != 0.0);
+        break;
+    default:
+        result = Value();
+        break;
+    }
+
+    return true;
+}
+
+Jit::Jit(const std::vector<std::string> & parameters, const std::vector<Token> & tokens, const Evaluator & caller)
+    : parameters(parameters)
+    , caller(caller)
+{
+    program.addLines(tokens);
+    program.addLine({ Token(Token::Type::EndOfFile, "", -1) });
+}
+
+void Jit::enable()
+{
+    enabled = true;
+}
+
+bool Jit::isEnabled()
+{
+    return enabled;
+}
+
+std::unique_ptr<NativeFunction> Jit::compile()
+{
+#if defined(__x86_64__) && !defined(_WIN32)
+    // rdi points to the slots of the variables, rsi to the result
+    std::vector<int> parameterSlots;
+    for (const auto & name : parameters)
+    {
+        if (caller.hasFunction(name))
+        {
+            return {};
+        }
+
+        auto [it, inserted] = slots.try_emplace(name, slots.size());
+        parameterSlots.push_back(it->second);
+    }
+
+    for (size_t line = 0; line < program.size(); line++)
+    {
+        tokens = program.getLine(line);
+        pc = 1;
+        if (!statement() || pc + 1 < tokens.size() || slots.size() > NativeFunction::MaxSlots)
+        {
+            return {};
+        }
+    }
+
+    // mov eax, 0; ret
+    emit({ 0xB8 });
+    emit32(0);
+    emit({ 0xC3 });
+
+    for (auto [position, target] : jumps)
+    {
+        auto offset = static_cast<int64_t>(labels[target]) - static_cast<int64_t>(position + 4);
+        std::memcpy(&code[position], &offset, 4);
+    }
+
+    return std::make_unique<NativeFunction>(code, std::move(parameterSlots));
+#else
+    return {};
+#endif
+}
+
+bool Jit::statement()
+{
+    auto tok = tokens.front();
+    if (isTakeItToTheTop(tokens))
+    {
+        tok.type = Token::Type::Continue;
+    }
+
+    switch (tok.type)
+    {
+    C(Variable):
+    {
+        // only "X is 5"
+        if (tokens[pc].type != Token::Type::Is || tokens[pc + 1].type != Token::Type::Number)
+        {
+            return false;
+        }
+
+        auto value = add({ .kind = Node::Kind::Number, .number = toNumber(tokens[pc + 1].value) });
+        pc += 2;
+        return assign(tok.value, value);
+    }
+    C(NewLine):
+        return blocks.empty() || closeBlock();
+    C(EndOfFile):
+        while (blocks.size())
+        {
+            if (!closeBlock())
+            {
+                return false;
+            }
+        }
+        return true;
+    C(Let):
+    {
+        auto name = tokens[pc++];
+        if (name.type != Token::Type::Variable || tokens[pc++].type != Token::Type::Be)
+        {
+            return false;
+        }
+
+        // no compound assignment
+        if (tokens.size() > pc + 3 && (tokens[pc + 2].type == Token::Type::Comma || tokens[pc + 3].type == Token::Type::Comma))
+        {
+            return false;
+        }
+
+        return assign(name.value, expression(name.value));
+    }
+    C(Put):
+    {
+        if (tokens[pc].type != Token::Type::Number && tokens[pc].type != Token::Type::Variable)
+        {
+            return false;
+        }
+
+        auto value = expression();
+        auto name = tokens[pc + 1];
+        if (tokens[pc].type != Token::Type::Into || name.type != Token::Type::Variable)
+        {
+            return false;
+        }
+        pc += 2;
+        return assign(name.value, value);
+    }
+    C(Build):
+    C(Knock):
+        return step(tok.type);
+    C(Give):
+    {
+        if (tokens[pc].type == Token::Type::Back)
+        {
+            pc++;
+        }
+
+        auto value = expression();
+        if (value < 0)
+        {
+            return false;
+        }
+
+        if (isNumber(value))
+        {
+            load(value);
+            // movsd [rsi], xmm0; mov eax, 1
+            emit({ 0xF2, 0x0F, 0x11, 0x06, 0xB8 });
+            emit32(1);
+        }
+        else
+        {
+            auto no = label();
+            auto done = label();
+            branch(value, false, no);
+            // mov rax, 1.0
+            emit({ 0x48, 0xB8 });
+            emit64(std::bit_cast<uint64_t>(1.0));
+            jump(done);
+            bind(no);
+            // xor eax, eax
+            emit({ 0x31, 0xC0 });
+            bind(done);
+            // mov [rsi], rax; mov eax, 2
+            emit({ 0x48, 0x89, 0x06, 0xB8 });
+            emit32(2);
+        }
+        // ret
+        emit({ 0xC3 });
+        return true;
+    }
+    C(If):
+    {
+        auto condition = expression();
+        if (condition < 0)
+        {
+            return false;
+        }
+
+        Block block { tok.type, 0, label(), label() };
+        branch(condition, false, block.otherwise);
+        blocks.push_back(block);
+        return true;
+    }
+    C(While):
+    C(Until):
+    {
+        Block block { tok.type, label(), label(), 0 };
+        bind(block.head);
+
+        auto condition = expression();
+        if (condition < 0)
+        {
+            return false;
+        }
+
+        branch(condition, tok.type == Token::Type::Until, block.exit);
+        blocks.push_back(block);
+        return true;
+    }
+    C(Break):
+    C(Continue):
+    {
+        if (tok.type == Token::Type::Break && tokens[pc].type == Token::Type::Pronoun && tokens[pc + 1].type == Token::Type::Down)
+        {
+            pc += 2;
+        }
+        else if (tok.type == Token::Type::Continue && tokens[pc].type == Token::Type::Pronoun
+                 && tokens[pc + 1].value == "to" && tokens[pc + 2].value == "the top")
+        {
+            pc += 3;
+        }
+
+        for (auto block = blocks.rbegin(); block != blocks.rend(); block++)
+        {
+            if (block->type == Token::Type::While || block->type == Token::Type::Until)
+            {
+                jump(tok.type == Token::Type::Break ? block->exit : block->head);
+                return true;
+            }
+        }
+        return false;
+    }
+    default:
+        // 'else' is left to the interpreter, which keeps the 'if' open after it
+        return false;
+    }
+}
+
+bool Jit::assign(std::string_view name, int node)
+{
+    if (node < 0 || !isNumber(node))
+    {
+        return false;
+    }
+
+    load(node);
+
+    auto index = slot(name);
+    if (index < 0)
+    {
+        // a variable is only known to be set when it is set outside of any block
+        if (blocks.size() || caller.hasFunction(name))
+        {
+            return false;
+        }
+        index = slots.emplace(std::string(name), slots.size()).first->second;
+    }
+
+    store(index);
+    return true;
+}
+
+bool Jit::step(Token::Type direction)
+{
+    auto index = tokens[pc].type == Token::Type::Variable ? slot(tokens[pc].value) : -1;
+    if (index < 0)
+    {
+        return false;
+    }
+    pc++;
+
+    bool up = direction == Token::Type::Build;
+    int count = 0;
+    do {
+        auto tok = tokens[pc++];
+        if (tok.type == (up ? Token::Type::Up : Token::Type::Down))
+        {
+            count++;
+        }
+        else if (tok.type != Token::Type::Comma)
+        {
+            return false;
+        }
+    } while (pc < tokens.size());
+    pc--;
+
+    auto variable = add({ .kind = Node::Kind::Slot, .slot = index });
+    auto amount = add({ .kind = Node::Kind::Number, .number = static_cast<double>(count) });
+    load(add({ .kind = Node::Kind::Arithmetic, .op = up ? Token::Type::Plus : Token::Type::Minus, .left = variable, .right = amount }));
+    store(index);
+    return true;
+}
+
+bool Jit::closeBlock()
+{
+    auto block = blocks.back();
+    blocks.pop_back();
+
+    if (block.type == Token::Type::If)
+    {
+        bind(block.otherwise);
+    }
+    else
+    {
+        jump(block.head);
+    }
+    bind(block.exit);
+    return true;
+}
+
+// the same grammar as Evaluator::evaluateExpression, leaving pc on the
+// first token it didn't use
+int Jit::expression(std::string_view variable)
+{
+    std::vector<int> terms;
+    std::vector<Token::Type> operators;
+
+    // the value of everything up to here
+    auto combine = [&]() {
+        if (!reduce(terms, operators) || terms.size() != 1)
+        {
+            return -1;
+        }
+
+        auto node = terms.back();
+        terms.clear();
+        return node;
+    };
+
+    auto implicitVariable = [&]() {
+        if (terms.empty() && variable.size())
+        {
+            terms.push_back(operand(tokens[1]));
+        }
+        return terms.empty() || terms.front() >= 0;
+    };
+
+    while (true)
+    {
+        auto current = tokens[pc];
+
+        switch (current.type)
+        {
+        C(Number):
+        C(Variable):
+            terms.push_back(operand(current));
+            if (terms.back() < 0)
+            {
+                return -1;
+            }
+            pc++;
+            break;
+        C(Plus):
+        C(Minus):
+            if (!implicitVariable() || !reduce(terms, operators))
+            {
+                return -1;
+            }
+            operators.push_back(current.type);
+            pc++;
+            break;
+        C(Times):
+        C(Over):
+            if (!implicitVariable())
+            {
+                return -1;
+            }
+            operators.push_back(current.type);
+            pc++;
+            break;
+        C(Is):
+        C(Isnt):
+        {
+            auto left = combine();
+
+            Node node { .kind = Node::Kind::Compare, .negate = current.type == Token::Type::Isnt, .left = left };
+            pc++;
+            switch (tokens[pc].type)
+            {
+            C(As):
+            {
+                auto size = tokens[++pc].type;
+                if ((size != Token::Type::Great && size != Token::Type::Little) || tokens[++pc].type != Token::Type::As)
+                {
+                    return -1;
+                }
+                node.comparison = Node::Comparison::GreaterOrEqual;
+                node.swap = size == Token::Type::Little;
+                pc++;
+                break;
+            }
+            C(Greater):
+            C(Lower):
+                node.comparison = Node::Comparison::Greater;
+                node.swap = tokens[pc].type == Token::Type::Lower;
+                if (tokens[++pc].type != Token::Type::Than)
+                {
+                    return -1;
+                }
+                pc++;
+                break;
+            C(Number):
+            C(Variable):
+                break;
+            default:
+                return -1;
+            }
+
+            node.right = operand(tokens[pc++]);
+            if (left < 0 || node.right < 0 || !isNumber(left))
+            {
+                return -1;
+            }
+            terms.push_back(add(node));
+            break;
+        }
+        C(And):
+        C(Or):
+        {
+            auto left = combine();
+            pc++;
+            auto right = expression();
+            if (left < 0 || right < 0)
+            {
+                return -1;
+            }
+            terms.push_back(add({ .kind = current.type == Token::Type::And ? Node::Kind::And : Node::Kind::Or, .left = left, .right = right }));
+            break;
+        }
+        C(String):
+        C(True):
+        C(False):
+        C(Null):
+        C(Mysterious):
+        C(Pronoun):
+        C(Not):
+        C(Taking):
+        C(At):
+        C(Roll):
+        C(Turn):
+            return -1;
+        default:
+            return combine();
+        }
+    }
+}
+
+// calculates the pending operators, in the postfix order Evaluator::calculate
+// gets them in
+bool Jit::reduce(std::vector<int> & terms, std::vector<Token::Type> & operators)
+{
+    while (operators.size())
+    {
+        if (terms.size() < 2)
+        {
+            return false;
+        }
+
+        auto right = terms.back(); terms.pop_back();
+        auto left = terms.back(); terms.pop_back();
+        if (!isNumber(left) || !isNumber(right))
+        {
+            return false;
+        }
+
+        terms.push_back(add({ .kind = Node::Kind::Arithmetic, .op = operators.back(), .left = left, .right = right }));
+        operators.pop_back();
+    }
+
+    return true;
+}
+
+int Jit::operand(const TokenRef & tok)
+{
+    switch (tok.type)
+    {
+    C(Number):
+        return add({ .kind = Node::Kind::Number, .number = toNumber(tok.value) });
+    C(Variable):
+    {
+        auto index = slot(tok.value);
+        return index < 0 ? -1 : add({ .kind = Node::Kind::Slot, .slot = index });
+    }
+    default:
+        return -1;
+    }
+}
+
+int Jit::slot(std::string_view name)
+{
+    auto it = slots.find(std::string(name));
+    return it == slots.end() ? -1 : it->second;
+}
+
+int Jit::add(Node node)
+{
+    nodes.push_back(node);
+    return nodes.size() - 1;
+}
+
+bool Jit::isNumber(int node) const
+{
+    switch (nodes[node].kind)
+    {
+    case Node::Kind::Number:
+    case Node::Kind::Slot:
+    case Node::Kind::Arithmetic:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Jit::load(int index)
+{
+    const auto & node = nodes[index];
+
+    switch (node.kind)
+    {
+    case Node::Kind::Number:
+        // mov rax, imm64; movq xmm0, rax
+        emit({ 0x48, 0xB8 });
+        emit64(std::bit_cast<uint64_t>(node.number));
+        emit({ 0x66, 0x48, 0x0F, 0x6E, 0xC0 });
+        break;
+    case Node::Kind::Slot:
+        // movsd xmm0, [rdi + slot]
+        emit({ 0xF2, 0x0F, 0x10, 0x87 });
+        emit32(node.slot * 8);
+        break;
+    case Node::Kind::Arithmetic:
+    {
+        auto right = nodes[node.right].kind;
+        load(node.left);
+        if (right == Node::Kind::Number || right == Node::Kind::Slot)
+        {
+            loadSecond(node.right);
+        }
+        else
+        {
+            // sub rsp, 8; movsd [rsp], xmm0
+            emit({ 0x48, 0x83, 0xEC, 0x08, 0xF2, 0x0F, 0x11, 0x04, 0x24 });
+            load(node.right);
+            // movapd xmm1, xmm0; movsd xmm0, [rsp]; add rsp, 8
+            emit({ 0x66, 0x0F, 0x28, 0xC8, 0xF2, 0x0F, 0x10, 0x04, 0x24, 0x48, 0x83, 0xC4, 0x08 });
+        }
+
+        uint8_t operation = 0;
+        switch (node.op)
+        {
+        C(Plus): operation = 0x58; break;
+        C(Minus): operation = 0x5C; break;
+        C(Times): operation = 0x59; break;
+        default: operation = 0x5E; break;
+        }
+        // addsd/subsd/mulsd/divsd xmm0, xmm1
+        emit({ 0xF2, 0x0F, operation, 0xC1 });
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// a number or a variable into xmm1, keeping xmm0
+void Jit::loadSecond(int index)
+{
+    const auto & node = nodes[index];
+
+    if (node.kind == Node::Kind::Number)
+    {
+        // mov rax, imm64; movq xmm1, rax
+        emit({ 0x48, 0xB8 });
+        emit64(std::bit_cast<uint64_t>(node.number));
+        emit({ 0x66, 0x48, 0x0F, 0x6E, 0xC8 });
+    }
+    else
+    {
+        // movsd xmm1, [rdi + slot]
+        emit({ 0xF2, 0x0F, 0x10, 0x8F });
+        emit32(node.slot * 8);
+    }
+}
+
+// jumps to the label when the node is true, or false
+void Jit::branch(int index, bool when, size_t target)
+{
+    const auto & node = nodes[index];
+
+    switch (node.kind)
+    {
+    case Node::Kind::Compare:
+        load(node.left);
+        if (node.swap)
+        {
+            // movapd xmm1, xmm0
+            emit({ 0x66, 0x0F, 0x28, 0xC8 });
+            load(node.right);
+        }
+        else
+        {
+            loadSecond(node.right);
+        }
+        // ucomisd xmm0, xmm1
+        emit({ 0x66, 0x0F, 0x2E, 0xC1 });
+        compareJump(node.comparison, when != node.negate, target);
+        break;
+    case Node::Kind::And:
+    case Node::Kind::Or:
+    {
+        // the right side decides when the left one doesn't
+        bool decides = node.kind == Node::Kind::Or;
+        if (when == decides)
+        {
+            branch(node.left, when, target);
+            branch(node.right, when, target);
+        }
+        else
+        {
+            auto skip = label();
+            branch(node.left, decides, skip);
+            branch(node.right, when, target);
+            bind(skip);
+        }
+        break;
+    }
+    default:
+        // a number is true unless it is 0
+        load(index);
+        // xorpd xmm1, xmm1; ucomisd xmm0, xmm1
+        emit({ 0x66, 0x0F, 0x57, 0xC9, 0x66, 0x0F, 0x2E, 0xC1 });
+        compareJump(Node::Comparison::Equal, !when, target);
+        break;
+    }
+}
+
+// after a ucomisd, where unordered (NaN) compares false like in C++
+void Jit::compareJump(Node::Comparison comparison, bool when, size_t target)
+{
+    switch (comparison)
+    {
+    case Node::Comparison::Equal:
+        if (when)
+        {
+            auto skip = label();
+            jumpIf(0x8A, skip); // jp
+            jumpIf(0x84, target); // je
+            bind(skip);
+        }
+        else
+        {
+            jumpIf(0x8A, target); // jp
+            jumpIf(0x85, target); // jne
+        }
+        break;
+    case Node::Comparison::Greater:
+        jumpIf(when ? 0x87 : 0x86, target); // ja, jbe
+        break;
+    case Node::Comparison::GreaterOrEqual:
+        jumpIf(when ? 0x83 : 0x82, target); // jae, jb
+        break;
+    }
+}
+
+void Jit::store(int slot)
+{
+    // movsd [rdi + slot], xmm0
+    emit({ 0xF2, 0x0F, 0x11, 0x87 });
+    emit32(slot * 8);
+}
+
+void Jit::emit(std::initializer_list<uint8_t> bytes)
+{
+    code.insert(code.end(), bytes);
+}
+
+void Jit::emit32(uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        code.push_back(value >> (8 * i));
+    }
+}
+
+void Jit::emit64(uint64_t value)
+{
+    emit32(value);
+    emit32(value >> 32);
+}
+
+size_t Jit::label()
+{
+    labels.push_back(0);
+    return labels.size() - 1;
+}
+
+void Jit::bind(size_t label)
+{
+    labels[label] = code.size();
+}
+
+void Jit::jump(size_t label)
+{
+    emit({ 0xE9 });
+    jumps.emplace_back(code.size(), label);
+    emit32(0);
+}
+
+void Jit::jumpIf(uint8_t condition, size_t label)
+{
+    emit({ 0x0F, condition });
+    jumps.emplace_back(code.size(), label);
+    emit32(0);
+}
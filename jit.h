@@ -0,0 +1,132 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "token.h"
+#include "tokenstore.h"
+#include "value.h"
+
+class Evaluator;
+
+// x86-64 code of a function whose variables only ever hold numbers
+class NativeFunction
+{
+public:
+    NativeFunction(const std::vector<uint8_t> & code, std::vector<int> parameterSlots);
+    ~NativeFunction();
+    NativeFunction(const NativeFunction &) = delete;
+    NativeFunction & operator=(const NativeFunction &) = delete;
+
+    // false when an argument isn't a number, the function must then be evaluated
+    bool call(std::span<const Value> arguments, Value & result) const;
+
+    static constexpr size_t MaxSlots = 32;
+
+private:
+    // returns 0 when it falls off its end, 1 for a number and 2 for a
+    // boolean written to result
+    using Entry = int (*)(double * slots, double * result);
+
+    void * memory = nullptr;
+    size_t size = 0;
+    std::vector<int> parameterSlots;
+};
+
+// translates a function body, one template of machine code per statement
+class Jit
+{
+public:
+    Jit(const std::vector<std::string> & parameters, const std::vector<Token> & tokens, const Evaluator & caller);
+
+    // null when the body does something else than arithmetic on numbers
+    std::unique_ptr<NativeFunction> compile();
+
+    static void enable();
+    static bool isEnabled();
+
+private:
+    // an expression, numbers are calculated in xmm0 and conditions end in jumps
+    struct Node {
+        enum class Kind {
+            Number,
+            Slot,
+            Arithmetic,
+            Compare,
+            And,
+            Or,
+        };
+
+        // lower comparisons are greater ones with their sides swapped
+        enum class Comparison {
+            Equal,
+            Greater,
+            GreaterOrEqual,
+        };
+
+        Kind kind;
+        Token::Type op = Token::Type::EndOfFile;
+        double number = 0;
+        int slot = 0;
+        Comparison comparison = Comparison::Equal;
+        bool swap = false;
+        bool negate = false;
+        int left = -1;
+        int right = -1;
+    };
+
+    struct Block {
+        Token::Type type;
+        size_t head;
+        size_t exit;
+        size_t otherwise;
+    };
+
+    const std::vector<std::string> & parameters;
+    const Evaluator & caller;
+    TokenStore program;
+    TokenStore::Line tokens;
+    size_t pc = 0;
+
+    std::unordered_map<std::string, int> slots;
+    std::vector<Node> nodes;
+    std::vector<Block> blocks;
+
+    std::vector<uint8_t> code;
+    std::vector<size_t> labels;
+    // position of a rel32 and the label it jumps to
+    std::vector<std::pair<size_t, size_t>> jumps;
+
+    bool statement();
+    bool assign(std::string_view name, int node);
+    bool step(Token::Type direction);
+    bool closeBlock();
+
+    int expression(std::string_view variable = {});
+    bool reduce(std::vector<int> & terms, std::vector<Token::Type> & operators);
+    int operand(const TokenRef & tok);
+    int slot(std::string_view name);
+    int add(Node node);
+    bool isNumber(int node) const;
+
+    void load(int node);
+    void loadSecond(int node);
+    void branch(int node, bool when, size_t label);
+    void compareJump(Node::Comparison comparison, bool when, size_t label);
+    void store(int slot);
+
+    void emit(std::initializer_list<uint8_t> bytes);
+    void emit32(uint32_t value);
+    void emit64(uint64_t value);
+    size_t label();
+    void bind(size_t label);
+    void jump(size_t label);
+    void jumpIf(uint8_t condition, size_t label);
+};
+
+#endif // JIT_H
@@ -1,41 +1,222 @@
 #include <iostream>
-#include <fstream>
+#include <cerrno>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "scanner.h"
 #include "evaluator.h"
+#include "compiler.h"
+#include "function.h"
+#include "jit.h"
+#include "input.h"
+#include "output.h"
+#include "cache.h"
+#include "session.h"
+#include "error.h"
+#include "stream.h"
+#include <thread>
 
 void runFile(std::string filename);
-void run(std::string string);
+void run(std::string_view source);
+void runStream(int fd);
+void evaluate(Evaluator & evaluator);
+bool parseOption(std::string option);
+
+static bool useCache = false;
+
+enum class Mode {
+    Run,
+    Repl,
+    Watch,
+    EmitCpp,
+};
+static Mode mode = Mode::Run;
+static bool streaming = false;
 
 int main(int argc, char** argv)
 {
-    switch (argc)
+    std::string filename = "demo.rock";
+    int positionals = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.starts_with("--"))
+        {
+            if (!parseOption(arg))
+            {
+                std::cerr << "Unknown option '" << arg << "'\n";
+                return 1;
+            }
+        }
+        else
+        {
+            filename = arg;
+            positionals++;
+        }
+    }
+
+    if (positionals > 1 || (mode == Mode::Repl && positionals) || (mode == Mode::Watch && !positionals))
+    {
+        std::cerr << "Usage: rockstar [--flush=line|block|exit] [--cache] [--stream] [--jit] [--memoize] [script.rock | -]\n"
+                  << "       rockstar --repl\n"
+                  << "       rockstar --watch script.rock\n"
+                  << "       rockstar --emit-cpp [--cache] [script.rock | -] > script.cpp\n";
+        return 1;
+    }
+
+    switch (mode)
     {
-    case 1:
-        runFile("demo.rock");
+    case Mode::Run:
+    case Mode::EmitCpp:
+        try
+        {
+            runFile(filename);
+        }
+        catch (const ScriptError & error)
+        {
+            // the script couldn't be scanned, running it reports its own errors
+            std::cerr << error.what();
+            return 1;
+        }
         break;
-    case 2:
-        runFile(argv[1]);
+    case Mode::Repl:
+        Session().repl();
         break;
-    default:
-        std::cerr << "Usage: rockstar [script.rock]";
+    case Mode::Watch:
+        Session().watch(filename);
         break;
     }
 
     return 0;
 }
 
+bool parseOption(std::string option)
+{
+    auto & output = Output::standard();
+
+    if (option == "--flush=line") output.setFlushMode(Output::Flush::Line);
+    else if (option == "--flush=block") output.setFlushMode(Output::Flush::Block);
+    else if (option == "--flush=exit") output.setFlushMode(Output::Flush::Exit);
+    else if (option == "--cache") useCache = true;
+    else if (option == "--stream") streaming = true;
+    else if (option == "--repl") mode = Mode::Repl;
+    else if (option == "--watch") mode = Mode::Watch;
+    else if (option == "--emit-cpp") mode = Mode::EmitCpp;
+    else if (option == "--jit") Jit::enable();
+    else if (option == "--memoize") Function::enableMemoization();
+    else return false;
+
+    return true;
+}
+
 void runFile(std::string filename)
 {
-    std::ifstream ifs { filename };
-    std::string content { std::istreambuf_iterator<char>(ifs),
-                          std::istreambuf_iterator<char>() };
+    int fd = (filename == "-" ? STDIN_FILENO : open(filename.c_str(), O_RDONLY));
+    if (fd == STDIN_FILENO && mode != Mode::EmitCpp)
+    {
+        // lines taken by 'listen' would be missing from the script, and the other way around
+        Input::standard().reserve();
+    }
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        std::cerr << "Can't open '" << filename << "': " << std::strerror(errno) << '\n';
+        std::exit(1);
+    }
+
+    // pipes can't be mapped and may never end, run them as they come
+    if (mode != Mode::EmitCpp && (streaming || !S_ISREG(st.st_mode)))
+    {
+        runStream(fd);
+        close(fd);
+        return;
+    }
+
+    size_t size = st.st_size;
+    void * data = MAP_FAILED;
+    if (size > 0)
+    {
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    if (data != MAP_FAILED)
+    {
+        close(fd);
+        run({ static_cast<const char *>(data), size });
+        munmap(data, size);
+        return;
+    }
+
+    // not mappable (empty file, pipe...), read it the slow way
+    std::string content;
+    char chunk[1 << 16];
+    ssize_t count;
+    while ((count = read(fd, chunk, sizeof(chunk))) > 0)
+    {
+        content.append(chunk, count);
+    }
+    close(fd);
+
     run(content);
 }
 
-void run(std::string string)
+void run(std::string_view source)
+{
+    TokenStore program;
+    TokenCache cache(source);
+
+    if (!useCache || !cache.load(program))
+    {
+        Scanner scanner(source);
+        program.addLines(scanner.getTokens());
+        // saved with the program, so a loaded one is used without changing it
+        program.addEndOfFile();
+
+        if (useCache) cache.save(program);
+    }
+
+    if (mode == Mode::EmitCpp)
+    {
+        Compiler(std::move(program)).emit(std::cout);
+        return;
+    }
+
+    Evaluator evaluator(std::move(program));
+    evaluate(evaluator);
+}
+
+void runStream(int fd)
 {
-    Scanner scanner(string);
-    Evaluator evaluator(scanner.getTokens());
-    evaluator.eval();
+    // enough scanned chunks to keep the evaluator busy, few enough to bound memory
+    LineQueue queue(64);
+    StreamScanner scanner(fd, queue);
+    std::thread producer(&StreamScanner::run, &scanner);
+
+    Evaluator evaluator(queue);
+    evaluate(evaluator);
+
+    // a top-level 'give back' stops before the end, let the scanner finish
+    while (evaluator.isStreaming() && queue.pop().size())
+    {
+    }
+    producer.join();
+}
+
+void evaluate(Evaluator & evaluator)
+{
+    try
+    {
+        evaluator.eval();
+    }
+    catch (const ScriptError & error)
+    {
+        // exits right away, a scanning thread may still be running
+        std::cerr << error.what();
+        std::exit(1);
+    }
 }
@@ -0,0 +1,128 @@
+#include "output.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// big enough to turn millions of short lines into a few hundred syscalls
+static constexpr size_t BufferSize = 1 << 16;
+
+Output::Output(int fd)
+    : fd { fd }, mode { isatty(fd) ? Flush::Line : Flush::Block }, buffer(BufferSize)
+{
+}
+
+Output::~Output()
+{
+    flush();
+}
+
+Output & Output::standard()
+{
+    static Output out(STDOUT_FILENO);
+    return out;
+}
+
+void Output::setFlushMode(Flush mode)
+{
+    this->mode = mode;
+}
+
+void Output::flush()
+{
+    if (used)
+    {
+        writeAll(buffer.data(), used);
+        used = 0;
+    }
+}
+
+Output & Output::operator<<(std::string_view str)
+{
+    append(str.data(), str.size());
+
+    if (mode == Flush::Line && str.find('\n') != std::string_view::npos)
+    {
+        flush();
+    }
+
+    return *this;
+}
+
+Output & Output::operator<<(char c)
+{
+    append(&c, 1);
+
+    if (mode == Flush::Line && c == '\n')
+    {
+        flush();
+    }
+
+    return *this;
+}
+
+Output & Output::operator<<(const Value & value)
+{
+    if (value.isArray()) return *this << format(value.asDouble());
+    return *this << value.asString();
+}
+
+void Output::append(const char * data, size_t size)
+{
+    if (used + size <= buffer.size())
+    {
+        std::memcpy(buffer.data() + used, data, size);
+        used += size;
+    }
+    else if (mode == Flush::Exit)
+    {
+        // everything is kept until the program ends
+        buffer.resize(std::max(buffer.size() * 2, used + size));
+        std::memcpy(buffer.data() + used, data, size);
+        used += size;
+    }
+    else
+    {
+        // send what is pending and the new data in one go
+        writeAll(buffer.data(), used, data, size);
+        used = 0;
+    }
+}
+
+void Output::writeAll(const char * data, size_t size, const char * extra, size_t extraSize)
+{
+    iovec iov[2] = {
+        { const_cast<char *>(data), size },
+        { const_cast<char *>(extra), extraSize },
+    };
+    int count = extraSize ? 2 : 1;
+    iovec * current = iov;
+
+    while (count > 0)
+    {
+        auto written = writev(fd, current, count);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+
+            std::cerr << "Can't write to output: " << std::strerror(errno) << '\n';
+            std::_Exit(1);
+        }
+
+        // partial write, skip what has already been sent
+        while (count > 0 && static_cast<size_t>(written) >= current->iov_len)
+        {
+            written -= current->iov_len;
+            current++;
+            count--;
+        }
+
+        if (count > 0)
+        {
+            current->iov_base = static_cast<char *>(current->iov_base) + written;
+            current->iov_len -= written;
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <string_view>
+#include <vector>
+#include "value.h"
+
+class Output
+{
+public:
+    enum class Flush {
+        Line,
+        Block,
+        Exit,
+    };
+
+    explicit Output(int fd);
+    ~Output();
+
+    static Output & standard();
+
+    void setFlushMode(Flush mode);
+    void flush();
+
+    Output & operator<<(std::string_view str);
+    Output & operator<<(char c);
+    Output & operator<<(const Value & value);
+
+private:
+    void append(const char * data, size_t size);
+    void writeAll(const char * data, size_t size, const char * extra = nullptr, size_t extraSize = 0);
+
+    int fd;
+    Flush mode;
+    std::vector<char> buffer;
+    size_t used = 0;
+};
+
+#endif // OUTPUT_H
@@ -5,19 +5,38 @@ CONFIG -= qt
 TARGET = brockstar
 
 QMAKE_CXXFLAGS += -std=c++20
-LIBS += -lfmt
+LIBS += -lfmt -lpthread
 
 SOURCES += \
+        cache.cpp \
+        compiler.cpp \
         evaluator.cpp \
         function.cpp \
+        grammar.cpp \
+        input.cpp \
+        jit.cpp \
         main.cpp \
+        output.cpp \
         scanner.cpp \
+        session.cpp \
+        stream.cpp \
         token.cpp \
+        tokenstore.cpp \
         value.cpp
 
 HEADERS += \
+    cache.h \
+    compiler.h \
+    error.h \
     evaluator.h \
     function.h \
+    grammar.h \
+    input.h \
+    jit.h \
+    output.h \
     scanner.h \
+    session.h \
+    stream.h \
     token.h \
+    tokenstore.h \
     value.h
@@ -1,166 +1,271 @@
 #include "scanner.h"
 #include <algorithm>
-#include <boost/algorithm/string/split.hpp>
-#include <iostream>
-#include <utf8proc.h>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include "error.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using namespace std::string_literals;
 #define C(c) case Token::Type::c
 
-Scanner::Scanner(std::string source)
+namespace {
+
+// every word with a special meaning, aliases pointing to their keyword
+struct WordEntry {
+    std::string_view word;
+    std::string_view value;
+    Token::Type type;
+    Token::Type keyword;
+};
+
+#define ARTICLE(w) WordEntry { w, w, Token::Type::Article, Token::Type::Identifier }
+#define PRONOUN(w) WordEntry { w, w, Token::Type::Pronoun, Token::Type::Identifier }
+#define KEYWORD(w, k) WordEntry { w, w, Token::Type::Keyword, Token::Type::k }
+#define ALIAS(w, v, k) WordEntry { w, v, Token::Type::Keyword, Token::Type::k }
+constexpr std::array words {
+    ARTICLE("a"), ARTICLE("an"), ARTICLE("the"), ARTICLE("my"), ARTICLE("your"),
+
+    PRONOUN("it"), PRONOUN("he"), PRONOUN("she"), PRONOUN("him"), PRONOUN("her"),
+    PRONOUN("they"), PRONOUN("them"), PRONOUN("ze"), PRONOUN("hir"), PRONOUN("zie"),
+    PRONOUN("zir"), PRONOUN("xe"), PRONOUN("xem"), PRONOUN("ve"), PRONOUN("ver"),
+
+    KEYWORD("is", Is), KEYWORD("into", Into), KEYWORD("put", Put), KEYWORD("shout", Shout),
+    KEYWORD("plus", Plus), KEYWORD("minus", Minus), KEYWORD("times", Times), KEYWORD("over", Over),
+    KEYWORD("says", Says), KEYWORD("true", True), KEYWORD("false", False), KEYWORD("null", Null),
+    KEYWORD("knock", Knock), KEYWORD("down", Down), KEYWORD("build", Build), KEYWORD("up", Up),
+    KEYWORD("let", Let), KEYWORD("be", Be), KEYWORD("and", And), KEYWORD("takes", Takes),
+    KEYWORD("taking", Taking), KEYWORD("give", Give), KEYWORD("back", Back), KEYWORD("at", At),
+    KEYWORD("rock", Rock), KEYWORD("like", Like), KEYWORD("roll", Roll), KEYWORD("turn", Turn),
+    KEYWORD("mysterious", Mysterious), KEYWORD("if", If), KEYWORD("while", While), KEYWORD("else", Else),
+    KEYWORD("or", Or), KEYWORD("until", Until), KEYWORD("not", Not), KEYWORD("isnt", Isnt),
+    KEYWORD("greater", Greater), KEYWORD("lower", Lower), KEYWORD("great", Great), KEYWORD("little", Little),
+    KEYWORD("as", As), KEYWORD("than", Than), KEYWORD("nor", Nor), KEYWORD("listen", Listen),
+    KEYWORD("break", Break), KEYWORD("continue", Continue),
+
+    ALIAS("are", "is", Is), ALIAS("were", "is", Is), ALIAS("was", "is", Is),
+    ALIAS("say", "shout", Shout), ALIAS("whisper", "shout", Shout),
+    ALIAS("with", "plus", Plus),
+    ALIAS("without", "minus", Minus),
+    ALIAS("of", "times", Times),
+    ALIAS("between", "over", Over),
+    ALIAS("nothing", "null", Null), ALIAS("gone", "null", Null), ALIAS("nowhere", "null", Null), ALIAS("nobody", "null", Null),
+    ALIAS("wrong", "false", False), ALIAS("no", "false", False), ALIAS("lies", "false", False),
+    ALIAS("right", "true", True), ALIAS("yes", "true", True), ALIAS("ok", "true", True),
+    ALIAS("wants", "takes", Takes),
+    ALIAS("return", "give", Give),
+    ALIAS("aint", "isnt", Isnt),
+    ALIAS("higher", "greater", Greater), ALIAS("bigger", "greater", Greater), ALIAS("stronger", "greater", Greater),
+    ALIAS("less", "lower", Lower), ALIAS("smaller", "lower", Lower), ALIAS("weaker", "lower", Lower),
+    ALIAS("high", "great", Great), ALIAS("big", "great", Great), ALIAS("strong", "great", Great),
+    ALIAS("low", "little", Little), ALIAS("small", "little", Little), ALIAS("weak", "little", Little),
+};
+#undef ARTICLE
+#undef PRONOUN
+#undef KEYWORD
+#undef ALIAS
+
+constexpr uint32_t hashWord(std::string_view word, uint32_t seed)
+{
+    for (auto c : word)
+    {
+        seed = (seed ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return seed;
+}
+
+// slot -> index + 1 in words, 0 when empty
+struct WordTable {
+    bool found = false;
+    uint32_t seed = 0;
+    std::array<uint8_t, 4096> slots {};
+};
+
+// looks for a seed giving each word its own slot, so a lookup is a single probe
+consteval WordTable buildWordTable()
 {
-    std::vector<std::string> words;
+    static_assert(words.size() < 255);
 
-    std::string preSource;
-    for (size_t i = 0; i < source.size(); i++)
+    for (uint32_t seed = 2166136261u; seed < 2166136261u + 1000; seed++)
     {
-        auto c = source[i];
-        if (c == '(')
-        {
-            while (c != ')')
-            {
-                c = source[++i];
-            }
-        }
-        else
+        WordTable table;
+        table.seed = seed;
+        table.found = true;
+
+        for (size_t i = 0; i < words.size() && table.found; i++)
         {
-            preSource += c;
+            auto & slot = table.slots[hashWord(words[i].word, seed) % table.slots.size()];
+            table.found = (slot == 0);
+            slot = i + 1;
         }
+
+        if (table.found) return table;
     }
 
-    source = preSource;
+    return {};
+}
+
+constexpr auto wordTable = buildWordTable();
+static_assert(wordTable.found, "no perfect hash for the keyword table, try another seed range");
+
+// same classes as the SIMD code in Scanner::loadBlock, without going through the locale
+constexpr auto charClasses = [] {
+    std::array<uint8_t, 256> classes {};
+    for (int c = 'a'; c <= 'z'; c++) classes[c] = Scanner::Identifier;
+    for (int c = 'A'; c <= 'Z'; c++) classes[c] = Scanner::Identifier;
+    for (int c = '0'; c <= '9'; c++) classes[c] = Scanner::Number;
+    classes['\''] = Scanner::Identifier;
+    classes['.'] = classes['+'] = classes['-'] = Scanner::Number;
+    classes['"'] = classes['('] = classes['\n'] = classes[','] = Scanner::Special;
+    return classes;
+}();
+
+}
+
+
+Scanner::Scanner(std::string_view source)
+    : source { source }
+{
+    size_t threads = std::min<size_t>(std::thread::hardware_concurrency(), source.size() / MinimumChunkSize);
 
-    for (size_t i = 0; i < source.size();)
+    if (threads > 1)
     {
-        auto c = source[i];
-        std::string word;
+        scanInParallel(threads);
+    }
+    else
+    {
+        scan();
+    }
+}
 
-        if (isIdentifier(c))
-        {
-            while (isIdentifier(c))
-            {
-                word += c;
-                c = source[++i];
-            }
+Scanner::Scanner(std::string_view source, int firstLine)
+    : source { source }, line { firstLine }, isChunk { true }
+{
+    scan();
+}
 
-            words.emplace_back(word);
-        }
-        else if (isNumber(c))
-        {
-            while (isNumber(c))
-            {
-                word += c;
-                c = source[++i];
-            }
+void Scanner::scanInParallel(size_t count)
+{
+    auto chunks = splitAtNewLines(count);
 
-            words.emplace_back(word);
-        }
-        else if (c == '"')
-        {
-            do
-            {
-                word += c;
-                c = source[++i];
-            } while (c != '"');
-            word += c;
-            i++;
+    struct Result {
+        std::vector<Token> tokens;
+        std::string error;
+    };
 
-            words.emplace_back(word);
-        }
-        else if (c == '\n')
-        {
-            words.push_back("\n");
-            i++;
-        }
-        else if (c == ',')
-        {
-            words.push_back(",");
-            i++;
-        }
-        // skipped characters like spaces
-        else
+    std::vector<Result> results(chunks.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < chunks.size(); i++)
+    {
+        threads.emplace_back([&chunks, &results, i]() {
+            Scanner scanner(chunks[i].source, chunks[i].firstLine);
+            results[i] = { std::move(scanner.tokens), std::move(scanner.error) };
+        });
+    }
+
+    Scanner first(chunks[0].source, chunks[0].firstLine);
+    results[0] = { std::move(first.tokens), std::move(first.error) };
+
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+
+    // report the error the sequential scan would have stopped at
+    size_t total = 0;
+    for (auto & result : results)
+    {
+        if (result.error.size())
         {
-            i++;
+            isChunk = false;
+            fail(result.error);
         }
+        total += result.tokens.size();
     }
 
-    int lineIndex = 1;
+    tokens.reserve(total);
+    for (auto & result : results)
+    {
+        tokens.insert(tokens.end(), std::make_move_iterator(result.tokens.begin()), std::make_move_iterator(result.tokens.end()));
+    }
+}
+
+std::vector<Scanner::Chunk> Scanner::splitAtNewLines(size_t count)
+{
+    // the scanner state is reset at every new line that is outside of a
+    // string or a comment, so those are where the source can be cut
+    std::vector<Chunk> chunks;
+    auto chunkSize = source.size() / count;
 
-    std::vector<Token> preTokens;
-    auto isString = false;
-    std::string String;
-    for (auto word : words)
+    size_t chunkStart = 0;
+    size_t position = 0;
+    int firstLine = line;
+    int lines = 0;
+
+    while (chunkStart + chunkSize < source.size())
     {
-        auto type = Token::Type::Identifier;
+        auto target = chunkStart + chunkSize;
+        auto special = std::min(source.find_first_of("\"(", position), source.size());
 
-        if (isString)
+        if (special > target)
         {
-            String += " " + word;
-            if (!word.ends_with("\""))
+            auto newline = source.find('\n', std::max(position, target));
+            if (newline < special)
             {
+                lines += std::count(source.begin() + position, source.begin() + newline + 1, '\n');
+                chunks.push_back({ source.substr(chunkStart, newline + 1 - chunkStart), firstLine });
+
+                chunkStart = position = newline + 1;
+                firstLine = line + lines;
                 continue;
             }
-
-            type = Token::Type::String;
-            word = String;
-            removeQuotes(word);
-            preTokens.emplace_back(type, word, lineIndex);
-            isString = false;
-            continue;
         }
 
-        if (isArticle(word))
-        {
-            type = Token::Type::Article;
-        }
-        else if (isPronoun(word))
+        if (special == source.size())
         {
-            type = Token::Type::Pronoun;
+            break;
         }
-        else if (isKeyword(word))
-        {
-            type = Token::Type::Keyword;
-        }
-        else if (word.starts_with("\""))
-        {
-            if (!word.ends_with("\""))
-            {
-                String += word;
-                isString = true;
-                continue;
-            }
 
-            removeQuotes(word);
-            type = Token::Type::String;
-        }
-        else if (word.size() == 0)
-        {
-            continue;
-        }
-        else if (word == "\n")
-        {
-            type = Token::Type::NewLine;
-            lineIndex++;
-        }
-        else if (word == ",")
-        {
-            type = Token::Type::Comma;
-        }
-        else if (std::all_of(begin(word), end(word), [this](auto c) { return isNumber(c); }))
-        {
-            type = Token::Type::Number;
-        }
+        // new lines inside strings and comments don't count
+        lines += std::count(source.begin() + position, source.begin() + special, '\n');
 
-        preTokens.emplace_back(type, word, lineIndex);
+        auto close = source.find(source[special] == '"' ? '"' : ')', special + 1);
+        position = (close == std::string_view::npos ? source.size() : close + 1);
     }
 
+    chunks.push_back({ source.substr(chunkStart), firstLine });
+    return chunks;
+}
+
+void Scanner::scan()
+{
+    // typical scripts average a token every six or seven bytes
+    tokens.reserve(source.size() / 6);
+
     auto isProperVariable = false;
     auto mergeNextWord = false;
     auto isPoeticNumberLiteral = false;
     auto isPoeticStringLiteral = false;
     bool hadPeriod = false;
-    for (int i = 0; auto tok : preTokens)
+
+    // keywords that can't start a poetic number literal
+    auto startsPoeticNumber = [this](const Word & word) {
+        return word.type != Token::Type::Keyword || !isSpecialTypeOrComparison(word.keyword);
+    };
+
+    auto tok = nextWord();
+    while (tok.type != Token::Type::EndOfFile)
     {
+        auto next = nextWord();
+
         if (tok.type == Token::Type::NewLine)
         {
             isPoeticNumberLiteral = false;
@@ -176,7 +281,7 @@ Scanner::Scanner(std::string source)
                 {
                     if (!hadPeriod)
                     {
-                        if (tok.value.find('.') != std::string::npos)
+                        if (tok.value.find('.') != std::string_view::npos)
                         {
                             tokens.back().value += '.';
                             hadPeriod = true;
@@ -185,13 +290,14 @@ Scanner::Scanner(std::string source)
                 }
                 else
                 {
+                    auto digit = static_cast<char>('0' + poeticNumberLiteralCount(tok.value));
                     if (tokens.back().type == Token::Type::Number)
                     {
-                        tokens.back().value += std::to_string(poeticNumberLiteralCount(tok.value));
+                        tokens.back().value += digit;
                     }
                     else
                     {
-                        tokens.emplace_back(Token::Type::Number, std::to_string(poeticNumberLiteralCount(tok.value)), tok.line);
+                        tokens.emplace_back(Token::Type::Number, std::string(1, digit), tok.line);
                     }
                 }
             }
@@ -200,44 +306,44 @@ Scanner::Scanner(std::string source)
         {
             if (tokens.back().type == Token::Type::String)
             {
-                tokens.back().value += " " + tok.value;
+                tokens.back().value += ' ';
+                tokens.back().value += tok.value;
             }
             else
             {
-                tokens.emplace_back(Token::Type::String, tok.value, lineIndex);
+                tokens.emplace_back(Token::Type::String, std::string(tok.value), tok.line);
             }
         }
         else if (!mergeNextWord && tok.type == Token::Type::Identifier && std::isupper(tok.value[0]))
         {
             if (isProperVariable)
             {
-                properVariableCase(tok.value);
-                tokens.back().value += " " + tok.value;
+                tokens.back().value += ' ';
+                appendProperCase(tokens.back().value, tok.value);
             }
 
-            if (preTokens[i + 1].type == Token::Type::Identifier)
+            if (next.type == Token::Type::Identifier)
             {
-                if (!std::isupper(preTokens[i + 1].value[0]))
+                if (!std::isupper(next.value[0]))
                 {
-                    std::cerr << "Invalid proper variable on line " << preTokens[i + 1].line << '\n';
-                    std::exit(1);
+                    std::ostringstream message;
+                    message << "Invalid proper variable on line " << next.line << '\n';
+                    return fail(message.str());
                 }
 
                 if (!isProperVariable)
                 {
                     isProperVariable = true;
-                    properVariableCase(tok.value);
-                    tok.type = Token::Type::Variable;
-                    tokens.push_back(tok);
+                    auto & var = tokens.emplace_back(Token::Type::Variable, std::string(), tok.line);
+                    appendProperCase(var.value, tok.value);
                 }
             }
             else
             {
                 if (!isProperVariable)
                 {
-                    lowerCase(tok.value);
-                    tok.type = Token::Type::Variable;
-                    tokens.push_back(tok);
+                    auto & var = tokens.emplace_back(Token::Type::Variable, std::string(), tok.line);
+                    appendLowerCase(var.value, tok.value);
                 }
 
                 isProperVariable = false;
@@ -250,274 +356,312 @@ Scanner::Scanner(std::string source)
             if (name.ends_with("'s") || name.ends_with("'re"))
             {
                 name = name.substr(0, name.find('\''));
-                tok.value = name;
                 nextIsIs = true;
             }
-            else
-            {
-                name.erase (std::remove(name.begin(), name.end(), '\''), name.end());
-            }
 
             if (mergeNextWord)
             {
-                lowerCase(tok.value);
-                tokens.back().value += " " + tok.value;
+                tokens.back().value += ' ';
+                appendLowerCase(tokens.back().value, name);
                 mergeNextWord = false;
             }
             else
             {
-                tok.type = Token::Type::Variable;
-                tokens.push_back(tok);
+                tokens.emplace_back(Token::Type::Variable, std::string(name), tok.line);
             }
 
             if (nextIsIs)
             {
-                tokens.push_back(Token(Token::Type::Is, "is", tok.line));
-
-                auto t = preTokens[i + 1].type;
-                isPoeticNumberLiteral = (t != Token::Type::Number);
-
-                if (t == Token::Type::Keyword)
-                {
-                    auto value = preTokens[i + 1].value;
-                    auto kType = convertKeyword(value);
-                    if (isSpecialTypeOrComparison(kType))
-                    {
-                        isPoeticNumberLiteral = false;
-                    }
-                }
+                tokens.emplace_back(Token::Type::Is, "is", tok.line);
+                isPoeticNumberLiteral = (next.type != Token::Type::Number) && startsPoeticNumber(next);
             }
         }
         else if (tok.type == Token::Type::Article)
         {
             mergeNextWord = true;
-            lowerCase(tok.value);
-            tok.type = Token::Type::Variable;
-            tokens.push_back(tok);
+            tokens.emplace_back(Token::Type::Variable, std::string(tok.value), tok.line);
 
-            if (preTokens[i + 1].type != Token::Type::Identifier)
+            if (next.type != Token::Type::Identifier)
             {
-                std::cerr << "Unterminated common variable, got token " << preTokens[i + 1] << " on line " << lineIndex << '\n';
-                std::exit(1);
+                std::ostringstream message;
+                message << "Unterminated common variable, got token " << Token(next.type, "", next.line) << " on line " << tok.line << '\n';
+                return fail(message.str());
             }
         }
         else
         {
-            if (tok.type == Token::Type::Keyword)
+            auto type = tok.type;
+            if (type == Token::Type::Keyword)
             {
-                tok.type = convertKeyword(tok.value);
+                type = tok.keyword;
             }
-            tokens.push_back(tok);
+            tokens.emplace_back(type, std::string(tok.value), tok.line);
 
-            if (tok.type == Token::Type::Is)
+            if (type == Token::Type::Is)
             {
-                auto t = preTokens[i + 1].type;
-                isPoeticNumberLiteral = (t != Token::Type::Number && t != Token::Type::String);
-
-                if (t == Token::Type::Keyword)
-                {
-                    auto value = preTokens[i + 1].value;
-                    auto kType = convertKeyword(value);
-                    if (isSpecialTypeOrComparison(kType))
-                    {
-                        isPoeticNumberLiteral = false;
-                    }
-                }
+                isPoeticNumberLiteral = (next.type != Token::Type::Number && next.type != Token::Type::String) && startsPoeticNumber(next);
             }
-            else if (tok.type == Token::Type::Says)
+            else if (type == Token::Type::Says)
             {
                 isPoeticStringLiteral = true;
             }
-            else if (tok.type == Token::Type::Like)
+            else if (type == Token::Type::Like)
             {
                 isPoeticNumberLiteral = true;
             }
         }
 
-        i++;
+        tok = next;
     }
+}
 
-    /*for (auto t : tokens)
+void Scanner::fail(std::string message)
+{
+    // chunks can't exit on their own, an earlier chunk may fail first
+    if (isChunk)
     {
-        std::cerr << t << '\n';
-    }*/
+        error = std::move(message);
+        return;
+    }
+
+    throwScriptError(message);
 }
 
-std::vector<Token> Scanner::getTokens()
+Scanner::Word Scanner::nextWord()
+{
+    while (position < source.size())
+    {
+        // skipped characters like spaces
+        position = findClass(position, Identifier | Number | Special, true);
+        if (position >= source.size())
+        {
+            break;
+        }
+
+        auto c = source[position];
+        auto start = position;
+
+        if (isIdentifier(c))
+        {
+            position = findClass(position, Identifier, false);
+            return classify(source.substr(start, position - start));
+        }
+        else if (isNumber(c))
+        {
+            position = findClass(position, Number, false);
+            return { Token::Type::Number, source.substr(start, position - start), line };
+        }
+        else if (c == '"')
+        {
+            auto close = source.find('"', start + 1);
+            if (close == std::string_view::npos)
+            {
+                // unterminated strings are dropped
+                position = source.size();
+                break;
+            }
+
+            position = close + 1;
+            return { Token::Type::String, source.substr(start + 1, close - start - 1), line };
+        }
+        else if (c == '(')
+        {
+            auto close = source.find(')', start);
+            position = (close == std::string_view::npos ? source.size() : close + 1);
+        }
+        else if (c == '\n')
+        {
+            position++;
+            return { Token::Type::NewLine, "\n", ++line };
+        }
+        else // if (c == ',')
+        {
+            position++;
+            return { Token::Type::Comma, ",", line };
+        }
+    }
+
+    return { Token::Type::EndOfFile, {}, line };
+}
+
+Scanner::Word Scanner::classify(std::string_view word)
 {
-    return tokens;
+    auto key = lowered(word);
+
+    if (key.size())
+    {
+        auto slot = wordTable.slots[hashWord(key, wordTable.seed) % wordTable.slots.size()];
+        if (slot)
+        {
+            const auto & entry = words[slot - 1];
+
+            // only keywords may be written with apostrophes
+            if (entry.word == key && (entry.type == Token::Type::Keyword || key.size() == word.size()))
+            {
+                return { entry.type, entry.value, line, entry.keyword };
+            }
+        }
+    }
+
+    return { Token::Type::Identifier, word, line };
 }
 
-bool Scanner::isNumber(int c)
+std::vector<Token> Scanner::getTokens()
 {
-    return isdigit(c) || c == '.' || c == '+' || c == '-';
+    return std::move(tokens);
 }
 
-bool Scanner::isIdentifier(int c)
+const std::string & Scanner::getError() const
 {
-    return isalpha(c) || c == '\'';
+    return error;
 }
 
-static const std::vector<std::string> pronouns = {
-    "it",
-    "he",
-    "she",
-    "him",
-    "her",
-    "they",
-    "them",
-    "ze",
-    "hir",
-    "zie",
-    "zir",
-    "xe",
-    "xem",
-    "ve",
-    "ver",
-};
-bool Scanner::isPronoun(std::string & word)
+size_t Scanner::findClass(size_t from, uint8_t classes, bool inClass)
 {
-    auto s = word;
-    lowerCase(s);
-    bool found = std::count(begin(pronouns), end(pronouns), s) > 0;
-    if (found)
+    while (from < source.size())
     {
-        word = s;
+        auto blockStart = from & ~size_t(BlockSize - 1);
+        if (blockStart != block.start)
+        {
+            loadBlock(blockStart);
+        }
+
+        uint64_t bits = 0;
+        if (classes & Identifier) bits |= block.identifier;
+        if (classes & Number) bits |= block.number;
+        if (classes & Special) bits |= block.special;
+        if (!inClass) bits = ~bits;
+
+        bits >>= (from - blockStart);
+        if (bits)
+        {
+            return std::min(from + std::countr_zero(bits), source.size());
+        }
+
+        from = blockStart + BlockSize;
     }
-    return found;
+
+    return source.size();
 }
 
-static const std::vector<std::string> articles = {
-    "a", "an", "the", "my", "your"
-};
-bool Scanner::isArticle(std::string & word)
+void Scanner::loadBlock(size_t start)
 {
-    auto s = word;
-    lowerCase(s);
-    bool found = std::count(begin(articles), end(articles), s) > 0;
-    if (found)
+    const char * data = source.data() + start;
+
+    // the last block is padded with characters that belong to no class
+    alignas(BlockSize) char tail[BlockSize] = {};
+    if (source.size() - start < BlockSize)
     {
-        word = s;
+        std::memcpy(tail, data, source.size() - start);
+        data = tail;
     }
-    return found;
-}
 
-static const std::vector<std::string> keywords = {
-    "is", "into", "put", "shout", "plus", "minus", "times", "over",
-    "says", "true", "false", "null", "knock", "down", "build", "up",
-    "let", "be", "and", "whisper", "takes", "taking", "give", "back",
-    "at", "rock", "like", "roll", "turn", "mysterious", "if", "while",
-    "else", "or", "until", "not", "isnt", "is", "greater", "lower",
-    "great", "little", "as", "than", "nor",
-};
-bool Scanner::isKeyword(std::string & word)
-{
-    auto s = word;
-    s.erase (std::remove(s.begin(), s.end(), '\''), s.end());
-    lowerCase(s);
-    checkIfAlias(s);
-    bool found = std::count(begin(keywords), end(keywords), s) > 0;
-    if (found)
+    block.start = start;
+    block.identifier = 0;
+    block.number = 0;
+    block.special = 0;
+
+#if defined(__AVX2__)
+    auto inRange = [](__m256i c, char low, char high) {
+        auto offset = _mm256_sub_epi8(c, _mm256_set1_epi8(low));
+        return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, _mm256_set1_epi8(high - low)), offset);
+    };
+    auto is = [](__m256i c, char value) {
+        return _mm256_cmpeq_epi8(c, _mm256_set1_epi8(value));
+    };
+    auto mask = [](__m256i m) {
+        return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(m)));
+    };
+
+    for (int i = 0; i < BlockSize; i += 32)
+    {
+        auto c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        auto letter = inRange(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z');
+        auto number = _mm256_or_si256(_mm256_or_si256(inRange(c, '0', '9'), is(c, '.')), _mm256_or_si256(is(c, '+'), is(c, '-')));
+        auto special = _mm256_or_si256(_mm256_or_si256(is(c, '"'), is(c, '(')), _mm256_or_si256(is(c, '\n'), is(c, ',')));
+
+        block.identifier |= mask(_mm256_or_si256(letter, is(c, '\''))) << i;
+        block.number |= mask(number) << i;
+        block.special |= mask(special) << i;
+    }
+#elif defined(__SSE2__)
+    auto inRange = [](__m128i c, char low, char high) {
+        auto offset = _mm_sub_epi8(c, _mm_set1_epi8(low));
+        return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(high - low)), offset);
+    };
+    auto is = [](__m128i c, char value) {
+        return _mm_cmpeq_epi8(c, _mm_set1_epi8(value));
+    };
+    auto mask = [](__m128i m) {
+        return static_cast<uint64_t>(_mm_movemask_epi8(m));
+    };
+
+    for (int i = 0; i < BlockSize; i += 16)
+    {
+        auto c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        auto letter = inRange(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z');
+        auto number = _mm_or_si128(_mm_or_si128(inRange(c, '0', '9'), is(c, '.')), _mm_or_si128(is(c, '+'), is(c, '-')));
+        auto special = _mm_or_si128(_mm_or_si128(is(c, '"'), is(c, '(')), _mm_or_si128(is(c, '\n'), is(c, ',')));
+
+        block.identifier |= mask(_mm_or_si128(letter, is(c, '\''))) << i;
+        block.number |= mask(number) << i;
+        block.special |= mask(special) << i;
+    }
+#else
+    for (int i = 0; i < BlockSize; i++)
     {
-        word = s;
+        auto classes = charClasses[static_cast<uint8_t>(data[i])];
+        block.identifier |= uint64_t(classes & Identifier ? 1 : 0) << i;
+        block.number |= uint64_t(classes & Number ? 1 : 0) << i;
+        block.special |= uint64_t(classes & Special ? 1 : 0) << i;
     }
-    return found;
+#endif
 }
 
-void Scanner::checkIfAlias(std::string & word)
+bool Scanner::isNumber(int c)
 {
-    if (word == "are" || word == "were" || word == "was") word = "is";
-    else if (word == "say" || word == "whisper") word = "shout";
-    else if (word == "with") word = "plus";
-    else if (word == "without") word = "minus";
-    else if (word == "of") word = "times";
-    else if (word == "between") word = "over";
-    else if (word == "nothing" || word == "gone" || word == "nowhere" || word == "nobody") word = "null";
-    else if (word == "wrong" || word == "no" || word == "lies") word = "false";
-    else if (word == "right" || word == "yes" || word == "ok") word = "true";
-    else if (word == "wants") word = "takes";
-    else if (word == "return") word = "give";
-    else if (word == "aint") word = "isnt";
-    else if (word == "higher" || word == "bigger" || word == "stronger") word = "greater";
-    else if (word == "less" || word == "smaller" || word == "weaker") word = "lower";
-    else if (word == "high" || word == "big" || word == "strong") word = "great";
-    else if (word == "low" || word == "small" || word == "weak") word = "little";
+    return charClasses[static_cast<uint8_t>(c)] & Number;
 }
 
-void Scanner::properVariableCase(std::string & word)
+bool Scanner::isIdentifier(int c)
 {
-    lowerCase(word);
-    word[0] = std::toupper(word[0]);
+    return charClasses[static_cast<uint8_t>(c)] & Identifier;
 }
 
-void Scanner::lowerCase(std::string & word)
+std::string_view Scanner::lowered(std::string_view word)
 {
-    std::transform(begin(word), end(word), begin(word), tolower);
+    size_t size = 0;
+    for (auto c : word)
+    {
+        if (c == '\'') continue;
+
+        // longer than anything in the tables
+        if (size == sizeof(lowerBuffer)) return {};
+
+        lowerBuffer[size++] = std::tolower(c);
+    }
+
+    return { lowerBuffer, size };
 }
 
-void Scanner::removeQuotes(std::string & word)
+void Scanner::appendProperCase(std::string & out, std::string_view word)
 {
-    word.erase(0, 1);
-    word.erase(word.size() - 1, 1);
+    auto start = out.size();
+    appendLowerCase(out, word);
+    out[start] = std::toupper(out[start]);
 }
 
-int Scanner::poeticNumberLiteralCount(std::string word)
+void Scanner::appendLowerCase(std::string & out, std::string_view word)
 {
-    auto c = std::count_if(begin(word), end(word), [](char c) { return isalpha(c) || c == '-'; });
-    return c % 10;
+    auto start = out.size();
+    out += word;
+    std::transform(begin(out) + start, end(out), begin(out) + start, tolower);
 }
 
-Token::Type Scanner::convertKeyword(std::string name)
+int Scanner::poeticNumberLiteralCount(std::string_view word)
 {
-    properVariableCase(name);
-
-#define P(k) if (name == #k) return Token::Type::k
-    P(Into);
-    P(Is);
-    P(Shout);
-    P(Plus);
-    P(Minus);
-    P(Times);
-    P(Over);
-    P(Says);
-    P(True);
-    P(False);
-    P(Let);
-    P(Put);
-    P(Be);
-    P(Null);
-    P(Knock);
-    P(Down);
-    P(Build);
-    P(Up);
-    P(And);
-    P(Takes);
-    P(Taking);
-    P(Give);
-    P(At);
-    P(Rock);
-    P(Like);
-    P(Roll);
-    P(Turn);
-    P(Mysterious);
-    P(Back);
-    P(If);
-    P(Else);
-    P(While);
-    P(Until);
-    P(Or);
-    P(Not);
-    P(Isnt);
-    P(Greater);
-    P(Lower);
-    P(As);
-    P(Great);
-    P(Little);
-    P(Than);
-    P(Nor);
-#undef P
-
-    return Token::Token::Identifier;
+    auto c = std::count_if(begin(word), end(word), [](char c) { return isalpha(c) || c == '-'; });
+    return c % 10;
 }
 
 bool Scanner::isSpecialTypeOrComparison(Token::Type type)
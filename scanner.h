@@ -1,31 +1,81 @@
 #ifndef SCANNER_H
 #define SCANNER_H
 
+#include <cstdint>
 #include <vector>
 #include "token.h"
 #include <string>
+#include <string_view>
 
 class Scanner
 {
 public:
-    Scanner(std::string source);
+    Scanner(std::string_view source);
+    // scans a piece of a bigger source, errors are kept instead of exiting
+    Scanner(std::string_view source, int firstLine);
 
+    // identifies the tokens it makes, to be bumped with any change to
+    // Token::Type or to what a source is scanned into
+    static constexpr uint32_t FormatVersion = 1;
+
+    // hands the tokens over, the scanner doesn't keep them
     std::vector<Token> getTokens();
+    const std::string & getError() const;
+
+    enum CharClass : uint8_t {
+        Identifier = 1,
+        Number = 2,
+        Special = 4,
+    };
+
 
 private:
+    // sources smaller than this aren't worth a thread
+    static constexpr size_t MinimumChunkSize = 1 << 20;
+
+    struct Chunk {
+        std::string_view source;
+        int firstLine;
+    };
+
+    struct Word {
+        Token::Type type;
+        std::string_view value;
+        int line;
+        Token::Type keyword = Token::Type::Identifier;
+    };
+
     std::vector<Token> tokens;
+    std::string_view source;
+    size_t position = 0;
+    int line = 1;
+    bool isChunk = false;
+    std::string error;
+    char lowerBuffer[16];
+
+    // character classes of 64 bytes of source, one bit per byte
+    static constexpr int BlockSize = 64;
+    struct Block {
+        size_t start = -1;
+        uint64_t identifier;
+        uint64_t number;
+        uint64_t special;
+    } block;
 
+    void scan();
+    void scanInParallel(size_t count);
+    std::vector<Chunk> splitAtNewLines(size_t count);
+    void fail(std::string message);
+    Word nextWord();
+    Word classify(std::string_view word);
+    size_t findClass(size_t from, uint8_t classes, bool inClass);
+    void loadBlock(size_t start);
     bool isNumber(int c);
     bool isIdentifier(int c);
-    bool isPronoun(std::string & word);
-    bool isArticle(std::string & word);
-    bool isKeyword(std::string & word);
-    void checkIfAlias(std::string & word);
-    void properVariableCase(std::string & word);
-    void lowerCase(std::string & word);
-    void removeQuotes(std::string & word);
-    int poeticNumberLiteralCount(std::string word);
-    Token::Type convertKeyword(std::string name);
+    std::string_view lowered(std::string_view word);
+    void appendProperCase(std::string & out, std::string_view word);
+    void appendLowerCase(std::string & out, std::string_view word);
+    int poeticNumberLiteralCount(std::string_view word);
     bool isSpecialTypeOrComparison(Token::Type type);
 };
 
@@ -0,0 +1,240 @@
+#include "session.h"
+#include "error.h"
+#include "input.h"
+#include "output.h"
+#include "scanner.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+Session::Session()
+    : evaluator { std::make_unique<Evaluator>(std::vector<Token>{}) }
+{
+}
+
+void Session::repl()
+{
+    bool interactive = isatty(STDIN_FILENO);
+    std::vector<Token> pending;
+    int depth = 0;
+    int lineNumber = 1;
+
+    while (true)
+    {
+        if (interactive)
+        {
+            Output::standard() << (depth ? "... " : "> ");
+        }
+
+        auto input = Input::standard().readLine();
+        if (!input)
+        {
+            break;
+        }
+
+        std::string text { *input };
+        text += '\n';
+
+        Scanner scanner(text, lineNumber);
+        if (scanner.getError().size())
+        {
+            std::cerr << scanner.getError();
+            pending.clear();
+            depth = 0;
+            continue;
+        }
+        lineNumber++;
+
+        auto tokens = scanner.getTokens();
+        if (opensBlock(tokens))
+        {
+            depth++;
+        }
+        else if (tokens.size() == 1 && depth > 0)
+        {
+            // an empty line closes the innermost block
+            depth--;
+        }
+
+        pending.insert(pending.end(), tokens.begin(), tokens.end());
+
+        // blocks only run once they are complete
+        if (depth == 0)
+        {
+            run(std::move(pending), false);
+            pending.clear();
+        }
+    }
+
+    if (pending.size())
+    {
+        run(std::move(pending), false);
+    }
+}
+
+void Session::watch(std::string filename)
+{
+    struct stat last {};
+
+    while (true)
+    {
+        struct stat st;
+        if (stat(filename.c_str(), &st) == 0
+                && (st.st_mtim.tv_sec != last.st_mtim.tv_sec
+                    || st.st_mtim.tv_nsec != last.st_mtim.tv_nsec
+                    || st.st_size != last.st_size))
+        {
+            last = st;
+
+            std::ifstream ifs { filename };
+            std::stringstream content;
+            content << ifs.rdbuf();
+            reload(content.str());
+
+            Output::standard().flush();
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+void Session::reload(std::string_view source)
+{
+    std::vector<std::string> lines;
+    for (size_t start = 0; start < source.size();)
+    {
+        auto end = std::min(source.find('\n', start), source.size());
+        lines.emplace_back(source.substr(start, end - start));
+        start = end + 1;
+    }
+
+    // strings and comments spanning several lines need the whole source
+    bool incremental = true;
+    for (const auto & text : lines)
+    {
+        incremental = incremental && isSelfContained(text);
+    }
+
+    if (!incremental)
+    {
+        Scanner scanner(source, 1);
+        if (scanner.getError().size())
+        {
+            std::cerr << scanner.getError();
+            return;
+        }
+
+        lineTokens.clear();
+        sourceLines = std::move(lines);
+        run(scanner.getTokens(), true);
+        return;
+    }
+
+    // only lines that weren't already there get scanned
+    std::unordered_map<std::string, std::vector<Token>> scanned;
+    std::vector<std::vector<Token>> tokensPerLine;
+    for (const auto & text : lines)
+    {
+        auto it = scanned.find(text);
+        if (it == scanned.end())
+        {
+            auto cached = lineTokens.find(text);
+            if (cached != lineTokens.end())
+            {
+                it = scanned.emplace(text, std::move(cached->second)).first;
+            }
+            else
+            {
+                Scanner scanner(text + '\n', 1);
+                if (scanner.getError().size())
+                {
+                    std::cerr << scanner.getError();
+                    return;
+                }
+                it = scanned.emplace(text, scanner.getTokens()).first;
+            }
+        }
+
+        auto & tokens = tokensPerLine.emplace_back(it->second);
+        for (auto & token : tokens)
+        {
+            token.line += tokensPerLine.size() - 1;
+        }
+    }
+    lineTokens = std::move(scanned);
+
+    // lines added at the end of the file run on top of the current state,
+    // any other change runs the whole script again
+    bool appended = lines.size() >= sourceLines.size()
+            && std::equal(sourceLines.begin(), sourceLines.end(), lines.begin());
+
+    std::vector<Token> tokens;
+    for (size_t i = (appended ? sourceLines.size() : 0); i < tokensPerLine.size(); i++)
+    {
+        tokens.insert(tokens.end(), tokensPerLine[i].begin(), tokensPerLine[i].end());
+    }
+
+    sourceLines = std::move(lines);
+    run(std::move(tokens), !appended);
+}
+
+void Session::run(std::vector<Token> tokens, bool restart)
+{
+    if (restart)
+    {
+        evaluator = std::make_unique<Evaluator>(std::move(tokens));
+    }
+    else
+    {
+        evaluator->append(std::move(tokens));
+    }
+
+    // a mistake only stops the statements it is in, the state stays
+    try
+    {
+        evaluator->eval();
+    }
+    catch (const ScriptError & error)
+    {
+        Output::standard().flush();
+        std::cerr << error.what();
+    }
+}
+
+bool Session::isSelfContained(std::string_view line)
+{
+    for (auto i = line.find_first_of("\"("); i != std::string_view::npos; i = line.find_first_of("\"(", i))
+    {
+        auto close = line.find(line[i] == '"' ? '"' : ')', i + 1);
+        if (close == std::string_view::npos)
+        {
+            return false;
+        }
+        i = close + 1;
+    }
+
+    return true;
+}
+
+bool Session::opensBlock(const std::vector<Token> & tokens)
+{
+    if (tokens.empty())
+    {
+        return false;
+    }
+
+    switch (tokens[0].type)
+    {
+    case Token::Type::If:
+    case Token::Type::While:
+    case Token::Type::Until:
+        return true;
+    default:
+        // function declaration
+        return tokens.size() > 1 && tokens[1].type == Token::Type::Takes;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "evaluator.h"
+#include "token.h"
+
+// keeps an evaluator alive between inputs, for the REPL and --watch
+class Session
+{
+public:
+    Session();
+
+    void repl();
+    void watch(std::string filename);
+
+private:
+    void reload(std::string_view source);
+    void run(std::vector<Token> tokens, bool restart);
+    bool isSelfContained(std::string_view line);
+    bool opensBlock(const std::vector<Token> & tokens);
+
+    std::unique_ptr<Evaluator> evaluator;
+
+    // last version of the watched file, and the tokens of each of its
+    // lines (numbered as if they were the first line)
+    std::vector<std::string> sourceLines;
+    std::unordered_map<std::string, std::vector<Token>> lineTokens;
+};
+
+#endif // SESSION_H
@@ -0,0 +1,160 @@
+#include "stream.h"
+#include "scanner.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+LineQueue::LineQueue(size_t capacity)
+    : slots(capacity)
+{
+}
+
+void LineQueue::push(std::vector<Token> chunk)
+{
+    auto position = tail.load(std::memory_order_relaxed);
+
+    // full, wait for the evaluator to catch up
+    auto consumed = head.load(std::memory_order_acquire);
+    while (position - consumed == slots.size())
+    {
+        head.wait(consumed, std::memory_order_acquire);
+        consumed = head.load(std::memory_order_acquire);
+    }
+
+    slots[position % slots.size()] = std::move(chunk);
+    tail.store(position + 1, std::memory_order_release);
+    tail.notify_one();
+}
+
+std::vector<Token> LineQueue::pop()
+{
+    auto position = head.load(std::memory_order_relaxed);
+
+    auto produced = tail.load(std::memory_order_acquire);
+    while (produced == position)
+    {
+        tail.wait(produced, std::memory_order_acquire);
+        produced = tail.load(std::memory_order_acquire);
+    }
+
+    auto chunk = std::move(slots[position % slots.size()]);
+    head.store(position + 1, std::memory_order_release);
+    head.notify_one();
+
+    return chunk;
+}
+
+void LineQueue::close(std::string error)
+{
+    // published by the release store in push()
+    this->error = std::move(error);
+    push({});
+}
+
+const std::string & LineQueue::getError() const
+{
+    return error;
+}
+
+StreamScanner::StreamScanner(int fd, LineQueue & queue)
+    : fd { fd }, queue { queue }
+{
+}
+
+void StreamScanner::run()
+{
+    char buffer[1 << 16];
+
+    while (true)
+    {
+        auto count = read(fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            if (count < 0)
+            {
+                queue.close(std::string("Can't read script: ") + std::strerror(errno) + '\n');
+                return;
+            }
+            break;
+        }
+
+        pending.append(buffer, count);
+
+        if (!scanUntil(findCut()))
+        {
+            return;
+        }
+    }
+
+    if (scanUntil(pending.size()))
+    {
+        queue.close();
+    }
+}
+
+size_t StreamScanner::findCut()
+{
+    // the last new line that isn't inside a string or a comment, where the
+    // scanner state resets
+    size_t cut = 0;
+
+    while (true)
+    {
+        auto i = pending.find_first_of("\"(\n", checked);
+        if (i == std::string::npos)
+        {
+            checked = pending.size();
+            return cut;
+        }
+
+        if (pending[i] == '\n')
+        {
+            cut = checked = i + 1;
+            continue;
+        }
+
+        auto close = pending.find(pending[i] == '"' ? '"' : ')', i + 1);
+        if (close == std::string::npos)
+        {
+            // read more before deciding
+            checked = i;
+            return cut;
+        }
+        checked = close + 1;
+    }
+}
+
+bool StreamScanner::scanUntil(size_t end)
+{
+    if (end == 0)
+    {
+        return true;
+    }
+
+    Scanner scanner(std::string_view(pending).substr(0, end), line);
+    if (scanner.getError().size())
+    {
+        queue.close(scanner.getError());
+        return false;
+    }
+
+    auto tokens = scanner.getTokens();
+    for (const auto & token : tokens)
+    {
+        if (token.type == Token::Type::NewLine) line++;
+    }
+
+    pending.erase(0, end);
+    checked -= std::min(checked, end);
+
+    if (tokens.size())
+    {
+        queue.push(std::move(tokens));
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "token.h"
+
+// bounded single producer / single consumer queue of scanned chunks,
+// each one ending at a new line. Both sides block with atomic waits.
+class LineQueue
+{
+public:
+    explicit LineQueue(size_t capacity);
+
+    void push(std::vector<Token> chunk);
+    // an empty chunk means there is nothing left
+    std::vector<Token> pop();
+    void close(std::string error = {});
+
+    const std::string & getError() const;
+
+private:
+    std::vector<std::vector<Token>> slots;
+    std::atomic<size_t> head = 0;
+    std::atomic<size_t> tail = 0;
+    std::string error;
+};
+
+// scans a script as it is being read and feeds the queue
+class StreamScanner
+{
+public:
+    StreamScanner(int fd, LineQueue & queue);
+
+    void run();
+
+private:
+    size_t findCut();
+    bool scanUntil(size_t end);
+
+    int fd;
+    LineQueue & queue;
+    std::string pending;
+    size_t checked = 0;
+    int line = 1;
+};
+
+#endif // STREAM_H
@@ -0,0 +1,109 @@
+// Counts the allocations made while running small scripts, through a
+// replacement operator new, and fails when the work repeated by a loop,
+// or by the calls it makes, allocates.
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include "evaluator.h"
+#include "scanner.h"
+
+static size_t allocations = 0;
+static bool counting = false;
+
+void * operator new(std::size_t size)
+{
+    if (counting) allocations++;
+
+    if (auto pointer = std::malloc(size ? size : 1))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void * operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void * pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void * pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void * pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void * pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+// allocations made by running the script, once it is scanned and prepared
+static size_t count(const std::string & source)
+{
+    TokenStore program;
+    program.addLines(Scanner(source).getTokens());
+    Evaluator evaluator(std::move(program));
+
+    allocations = 0;
+    counting = true;
+    evaluator.eval();
+    counting = false;
+
+    return allocations;
+}
+
+static std::string loop(int iterations)
+{
+    return "My counter is 0\n"
+           "My total is 0\n"
+           "While my counter is lower than " + std::to_string(iterations) + "\n"
+           "Let my total be with my counter\n"
+           "Put my total over 2 into my half\n"
+           "Build my counter up\n"
+           "\n";
+}
+
+static std::string calls(int iterations)
+{
+    // two lines, so that it is called instead of calculated in place
+    return "Twice takes a number\n"
+           "Put a number with a number into the sum\n"
+           "Give back the sum\n"
+           "\n"
+           "My counter is 0\n"
+           "While my counter is lower than " + std::to_string(iterations) + "\n"
+           "Put Twice taking my counter into my result\n"
+           "Build my counter up\n"
+           "\n";
+}
+
+// the allocations each iteration adds, which mustn't go past the limit
+static bool check(const char * name, std::string (*script)(int), double limit)
+{
+    auto few = count(script(1000));
+    auto many = count(script(2000));
+    auto perIteration = (static_cast<double>(many) - few) / 1000;
+
+    bool passed = perIteration <= limit;
+    std::printf("%-6s %s: %zu allocations for 1000 iterations, %zu for 2000, %g per iteration (limit %g)\n",
+                passed ? "ok" : "FAILED", name, few, many, perIteration, limit);
+    return passed;
+}
+
+int main()
+{
+    bool passed = check("loop", loop, 0);
+    passed = check("calls", calls, 0) && passed;
+
+    return passed ? 0 : 1;
+}
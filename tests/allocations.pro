@@ -0,0 +1,26 @@
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG -= qt
+TARGET = allocations
+
+QMAKE_CXXFLAGS += -std=c++20
+LIBS += -lfmt -lpthread
+INCLUDEPATH += ..
+
+SOURCES += \
+        allocations.cpp \
+        ../cache.cpp \
+        ../compiler.cpp \
+        ../evaluator.cpp \
+        ../function.cpp \
+        ../grammar.cpp \
+        ../input.cpp \
+        ../jit.cpp \
+        ../output.cpp \
+        ../scanner.cpp \
+        ../session.cpp \
+        ../stream.cpp \
+        ../token.cpp \
+        ../tokenstore.cpp \
+        ../value.cpp
@@ -0,0 +1,52 @@
+#!/bin/sh
+# Runs every script of tests/scripts with the interpreter and as the C++
+# --emit-cpp makes of it, and fails when their outputs differ. A script's
+# .in file, when there is one, is its input. Scripts of tests/scripts/refused
+# would run differently as C++, --emit-cpp must refuse them.
+# usage: tests/compare.sh path/to/brockstar
+
+if [ $# -ne 1 ]; then
+    echo "usage: $0 path/to/brockstar" >&2
+    exit 1
+fi
+
+brockstar=$1
+tests=$(cd "$(dirname "$0")" && pwd)
+root=$(dirname "$tests")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# the runtime is the same for every script
+for source in value output input; do
+    g++ -std=c++20 -O2 -Wall -Werror -I"$root" -c "$root/$source.cpp" -o "$work/$source.o" || exit 1
+done
+
+failed=0
+for script in "$tests"/scripts/*.rock; do
+    name=$(basename "$script" .rock)
+    input="${script%.rock}.in"
+    [ -f "$input" ] || input=/dev/null
+
+    "$brockstar" "$script" < "$input" > "$work/$name.expected" 2>&1
+    if "$brockstar" --emit-cpp "$script" > "$work/$name.cpp" \
+            && g++ -std=c++20 -O2 -Wall -Werror -I"$root" "$work/$name.cpp" "$work"/*.o -lfmt -o "$work/$name" \
+            && "$work/$name" < "$input" > "$work/$name.actual" 2>&1 \
+            && diff -u "$work/$name.expected" "$work/$name.actual"; then
+        echo "ok     $name"
+    else
+        echo "FAILED $name"
+        failed=1
+    fi
+done
+
+for script in "$tests"/scripts/refused/*.rock; do
+    name=refused/$(basename "$script" .rock)
+    if "$brockstar" --emit-cpp "$script" > /dev/null 2>&1; then
+        echo "FAILED $name"
+        failed=1
+    else
+        echo "ok     $name"
+    fi
+done
+
+exit $failed
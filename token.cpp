@@ -2,6 +2,11 @@
 #include <ostream>
 
 Token::Token(Type type, std::string value, int line)
+    : type { type }, value { std::move(value) }, line { line }
+{
+}
+
+TokenRef::TokenRef(Token::Type type, std::string_view value, int line)
     : type { type }, value { value }, line { line }
 {
 }
@@ -97,8 +102,15 @@ static const char* tokens_names[] = {
     "Nor",
     "Break",
     "Continue",
+    "Listen",
+    "EndOfFile",
 };
 std::ostream& operator<<(std::ostream& os, const Token& t)
+{
+    return os << TokenRef(t.type, t.value, t.line);
+}
+
+std::ostream& operator<<(std::ostream& os, const TokenRef& t)
 {
     os << tokens_names[t.type];
     if (t.type == Token::Type::Variable)
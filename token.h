@@ -2,6 +2,7 @@
 #define TOKEN_H
 
 #include <string>
+#include <string_view>
 #include "value.h"
 
 class Token
@@ -63,6 +64,7 @@ public:
         Nor,
         Break,
         Continue,
+        Listen,
         EndOfFile,
     };
 
@@ -74,6 +76,18 @@ public:
     int line;
 };
 
+// a token looked at in place, its text belongs to whoever stores the token
+class TokenRef
+{
+public:
+    TokenRef(Token::Type type, std::string_view value, int line);
+
+    Token::Type type;
+    std::string_view value;
+    int line;
+};
+
 std::ostream& operator<<(std::ostream& os, const Token& t);
+std::ostream& operator<<(std::ostream& os, const TokenRef& t);
 
 #endif // TOKEN_H
@@ -0,0 +1,199 @@
+#include "tokenstore.h"
+
+void TokenStore::addLines(const std::vector<Token> & tokens)
+{
+    own();
+    size_t lineStart = types.size();
+
+    for (const auto & token : tokens)
+    {
+        if (token.type == Token::Type::NewLine)
+        {
+            // keep empty lines for "end of block"
+            if (types.size() == lineStart)
+            {
+                types.push_back(token.type);
+                values.push_back(intern(token.value));
+                sourceLines.push_back(token.line);
+            }
+
+            lineStarts.push_back(types.size());
+            lineStart = types.size();
+        }
+        else
+        {
+            types.push_back(token.type);
+            values.push_back(intern(token.value));
+            sourceLines.push_back(token.line);
+        }
+    }
+
+    if (types.size() != lineStart)
+    {
+        lineStarts.push_back(types.size());
+    }
+}
+
+void TokenStore::addLine(const std::vector<Token> & tokens)
+{
+    own();
+    for (const auto & token : tokens)
+    {
+        types.push_back(token.type);
+        values.push_back(intern(token.value));
+        sourceLines.push_back(token.line);
+    }
+
+    lineStarts.push_back(types.size());
+}
+
+void TokenStore::addEndOfFile()
+{
+    if (size() == 0 || getLine(size() - 1).front().type != Token::Type::EndOfFile)
+    {
+        addLine({ Token(Token::Type::EndOfFile, "", -1) });
+    }
+}
+
+void TokenStore::removeLastLine()
+{
+    own();
+    lineStarts.pop_back();
+
+    auto end = lineStarts.back();
+    types.resize(end);
+    values.resize(end);
+    sourceLines.resize(end);
+}
+
+void TokenStore::clear()
+{
+    types.clear();
+    values.clear();
+    sourceLines.clear();
+    lineStarts.assign(1, 0);
+    ids.clear();
+    strings.clear();
+    mapped = {};
+}
+
+size_t TokenStore::size() const
+{
+    return lineStartArray().size() - 1;
+}
+
+size_t TokenStore::tokenCount() const
+{
+    return typeArray().size();
+}
+
+TokenStore::Line TokenStore::getLine(size_t line) const
+{
+    auto starts = lineStartArray();
+    return Line(this, starts[line], starts[line + 1]);
+}
+
+std::span<const uint8_t> TokenStore::typeArray() const
+{
+    return mapped.file ? mapped.types : std::span<const uint8_t>(types);
+}
+
+std::span<const uint32_t> TokenStore::valueArray() const
+{
+    return mapped.file ? mapped.values : std::span<const uint32_t>(values);
+}
+
+std::span<const int32_t> TokenStore::sourceLineArray() const
+{
+    return mapped.file ? mapped.sourceLines : std::span<const int32_t>(sourceLines);
+}
+
+std::span<const uint32_t> TokenStore::lineStartArray() const
+{
+    return mapped.file ? mapped.lineStarts : std::span<const uint32_t>(lineStarts);
+}
+
+size_t TokenStore::stringCount() const
+{
+    return mapped.file ? mapped.stringEnds.size() : strings.size();
+}
+
+std::string_view TokenStore::text(uint32_t id) const
+{
+    if (!mapped.file)
+    {
+        return strings[id];
+    }
+
+    auto start = (id ? mapped.stringEnds[id - 1] : 0);
+    return { mapped.strings + start, mapped.stringEnds[id] - start };
+}
+
+void TokenStore::own()
+{
+    if (!mapped.file)
+    {
+        return;
+    }
+
+    types.assign(mapped.types.begin(), mapped.types.end());
+    values.assign(mapped.values.begin(), mapped.values.end());
+    sourceLines.assign(mapped.sourceLines.begin(), mapped.sourceLines.end());
+    lineStarts.assign(mapped.lineStarts.begin(), mapped.lineStarts.end());
+    for (uint32_t id = 0; id < mapped.stringEnds.size(); id++)
+    {
+        const auto & stored = strings.emplace_back(text(id));
+        ids.emplace(stored, id);
+    }
+    mapped = {};
+}
+
+uint32_t TokenStore::intern(const std::string & value)
+{
+    auto it = ids.find(value);
+    if (it != ids.end())
+    {
+        return it->second;
+    }
+
+    uint32_t id = strings.size();
+    const auto & stored = strings.emplace_back(value);
+    ids.emplace(stored, id);
+
+    return id;
+}
+
+TokenStore::Line::Line(const TokenStore * store, uint32_t begin, uint32_t end)
+    : store { store }, begin { begin }, end { end }
+{
+}
+
+size_t TokenStore::Line::size() const
+{
+    return end - begin;
+}
+
+size_t TokenStore::Line::offset() const
+{
+    return begin;
+}
+
+TokenRef TokenStore::Line::front() const
+{
+    return (*this)[0];
+}
+
+TokenRef TokenStore::Line::operator[](size_t index) const
+{
+    if (index >= size())
+    {
+        return TokenRef(Token::Type::EndOfFile, {}, end > begin ? store->sourceLineArray()[end - 1] : -1);
+    }
+
+    auto i = begin + index;
+    if (const auto & mapped = store->mapped; mapped.file)
+    {
+        return TokenRef(static_cast<Token::Type>(mapped.types[i]), store->text(mapped.values[i]), mapped.sourceLines[i]);
+    }
+    return TokenRef(static_cast<Token::Type>(store->types[i]), store->strings[store->values[i]], store->sourceLines[i]);
+}
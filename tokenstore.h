@@ -0,0 +1,95 @@
+#ifndef TOKENSTORE_H
+#define TOKENSTORE_H
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "token.h"
+
+// tokens of a program, split in lines, stored as parallel arrays with
+// each distinct string kept only once
+class TokenStore
+{
+public:
+    // the tokens of one line, read in place without copying them
+    class Line
+    {
+    public:
+        Line() = default;
+
+        size_t size() const;
+        // position of the first token of the line in the store
+        size_t offset() const;
+        TokenRef front() const;
+        // past the end of the line reads as the end of file
+        TokenRef operator[](size_t index) const;
+
+    private:
+        friend class TokenStore;
+        Line(const TokenStore * store, uint32_t begin, uint32_t end);
+
+        const TokenStore * store = nullptr;
+        uint32_t begin = 0;
+        uint32_t end = 0;
+    };
+
+    // a new line starts after every NewLine, empty lines are kept since they end blocks
+    void addLines(const std::vector<Token> & tokens);
+    void addLine(const std::vector<Token> & tokens);
+    // the line after the last one, added unless the program already has it
+    void addEndOfFile();
+    void removeLastLine();
+    void clear();
+
+    size_t size() const;
+    size_t tokenCount() const;
+    // valid until the store is cleared
+    Line getLine(size_t line) const;
+
+private:
+    // saves the arrays as they are, and reads them back in place
+    friend class TokenCache;
+
+    uint32_t intern(const std::string & value);
+
+    // the arrays read, the ones below or those of a mapped cache file
+    std::span<const uint8_t> typeArray() const;
+    std::span<const uint32_t> valueArray() const;
+    std::span<const int32_t> sourceLineArray() const;
+    std::span<const uint32_t> lineStartArray() const;
+    size_t stringCount() const;
+    std::string_view text(uint32_t id) const;
+    // copies a mapped cache file in the arrays, before they are changed
+    void own();
+
+    std::vector<uint8_t> types;
+    std::vector<uint32_t> values;
+    std::vector<int32_t> sourceLines;
+    // index of the first token of each line, the last entry closes the last line
+    std::vector<uint32_t> lineStarts { 0 };
+
+    // a deque never moves its strings, the map can point into them
+    std::deque<std::string> strings;
+    std::unordered_map<std::string_view, uint32_t> ids;
+
+    // a cache file the store is read from in place, unmapped with the last
+    // store sharing it
+    struct Mapped {
+        std::shared_ptr<const char> file;
+        std::span<const uint8_t> types;
+        std::span<const uint32_t> values;
+        std::span<const int32_t> sourceLines;
+        std::span<const uint32_t> lineStarts;
+        // strings follow each other, each ends where the next starts
+        std::span<const uint32_t> stringEnds;
+        const char * strings = nullptr;
+    };
+    Mapped mapped;
+};
+
+#endif // TOKENSTORE_H
@@ -1,15 +1,34 @@
 #include "value.h"
+#include "error.h"
 #include <ostream>
 #include <cmath>
 #include <fmt/format.h>
 #include <iostream>
 #include <array>
+#include <charconv>
+#include <stdexcept>
 
 std::string format(double d)
 {
     return fmt::format("{:-f}", d);
 }
 
+double toNumber(std::string_view text)
+{
+    if (text.size() && text[0] == '+')
+    {
+        text.remove_prefix(1);
+    }
+
+    double d = 0;
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), d);
+    if (error != std::errc())
+    {
+        throw std::invalid_argument("toNumber");
+    }
+    return d;
+}
+
 using namespace std::string_literals;
 
 Value::Value()
@@ -28,7 +47,7 @@ Value::Value(double d)
 }
 
 Value::Value(std::string s)
-    : value { s }
+    : value { std::move(s) }
 {
 }
 
@@ -58,7 +77,7 @@ std::string Value::type() const
     return "WHAT?!!"s;
 }
 
-Value Value::operator+(const Value & other)
+Value Value::operator+(const Value & other) const
 {
     if (isString() || other.isString())
     {
@@ -68,12 +87,12 @@ Value Value::operator+(const Value & other)
     return Value(asDouble() + other.asDouble());
 }
 
-Value Value::operator-(const Value & other)
+Value Value::operator-(const Value & other) const
 {
     return Value(asDouble() - other.asDouble());
 }
 
-Value Value::operator*(const Value & other)
+Value Value::operator*(const Value & other) const
 {
     if (isString())
     {
@@ -88,12 +107,12 @@ Value Value::operator*(const Value & other)
             res += asString();
         }
 
-        return Value(res);
+        return Value(std::move(res));
     }
     return Value(asDouble() * other.asDouble());
 }
 
-Value Value::operator/(const Value & other)
+Value Value::operator/(const Value & other) const
 {
     return Value(asDouble() / other.asDouble());
 }
@@ -131,7 +150,7 @@ bool Value::isArray() const
 bool Value::asBool() const
 {
     if (isDouble()) return asDouble() != 0.0;
-    if (isString()) return asString().size() != 0;
+    if (isString()) return std::get<std::string>(value).size() != 0;
     if (isNull() || isUndefined()) return false;
     if (isArray()) return std::get<Array>(value).size() != 0;
     return std::get<bool>(value);
@@ -146,6 +165,11 @@ double Value::asDouble() const
     return std::get<double>(value);
 }
 
+const double * Value::number() const
+{
+    return std::get_if<double>(&value);
+}
+
 std::string Value::asString() const
 {
     if (isBool()) return asBool() ? "true"s : "false"s;
@@ -171,16 +195,15 @@ void Value::setIndex(int index, Value cellValue)
 {
     if (!isArray())
     {
-        std::cerr << "Can't index a variable of type " << type() << ", must be an array.\n";
-        std::exit(1);
+        throwScriptError("Can't index a variable of type ", type(), ", must be an array.\n");
     }
 
     auto & content = std::get<Array>(value);
     if (static_cast<int>(content.size()) <= index)
     {
         content.resize(index + 1);
-        content[index] = cellValue;
     }
+    content[index] = std::move(cellValue);
 }
 
 Value Value::getIndex(int index) const
@@ -200,13 +223,12 @@ Value Value::getIndex(int index) const
         }
         else
         {
-            std::cerr << "Index out of bound, " << index << " >= " << content.size() << ".\n";
-            std::exit(1);
+            throwScriptError("Index out of bound, ", index, " >= ", content.size(), ".\n");
         }
     }
     else // isString()
     {
-        auto str = asString();
+        const auto & str = std::get<std::string>(value);
 
         if (index < static_cast<int>(str.size()))
         {
@@ -214,8 +236,7 @@ Value Value::getIndex(int index) const
         }
         else
         {
-            std::cerr << "Index out of bound, " << index << " >= " << str.size() << ".\n";
-            std::exit(1);
+            throwScriptError("Index out of bound, ", index, " >= ", str.size(), ".\n");
         }
     }
 }
@@ -228,15 +249,14 @@ void Value::push(Value val)
     }
 
     auto & arr = std::get<Array>(value);
-    arr.push_back(val);
+    arr.push_back(std::move(val));
 }
 
 Value Value::pop()
 {
     if (!isArray())
     {
-        std::cerr << "Can't pop value from non-array\n";
-        std::exit(1);
+        throwScriptError("Can't pop value from non-array\n");
     }
 
     auto & arr = std::get<Array>(value);
@@ -245,7 +265,7 @@ Value Value::pop()
         return Value(Value::Special::Undefined);
     }
 
-    auto val = arr.front();
+    auto val = std::move(arr.front());
     arr.erase(arr.begin());
     return val;
 }
@@ -260,7 +280,7 @@ std::ostream& operator<<(std::ostream& os, const Value& v)
 
 bool operator==(const Value& l, const Value& r)
 {
-    if (l.type() == r.type())
+    if (l.value.index() == r.value.index())
     {
         if (l.isUndefined() || l.isNull())
         {
@@ -297,7 +317,7 @@ bool operator==(const Value& l, const Value& r)
 
         if (l.isString())
         {
-            return l.asString() == r.asString();
+            return std::get<std::string>(l.value) == std::get<std::string>(r.value);
         }
     }
 
@@ -352,7 +372,7 @@ bool operator<(const Value& l, const Value& r)
 
     if (l.isString() && r.isString())
     {
-        return l.asString() < r.asString();
+        return std::get<std::string>(l.value) < std::get<std::string>(r.value);
     }
 
     if (l.isBool() || r.isBool())
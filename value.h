@@ -3,12 +3,15 @@
 
 #include <variant>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Value;
 using Array = std::vector<Value>;
 
 std::string format(double d);
+// the scanner only makes decimal numbers, std::stod would need a std::string
+double toNumber(std::string_view text);
 
 class Value
 {
@@ -25,10 +28,10 @@ public:
 
     std::string type() const;
 
-    Value operator+(const Value & other);
-    Value operator-(const Value & other);
-    Value operator*(const Value & other);
-    Value operator/(const Value & other);
+    Value operator+(const Value & other) const;
+    Value operator-(const Value & other) const;
+    Value operator*(const Value & other) const;
+    Value operator/(const Value & other) const;
 
     bool isNull() const;
     bool isBool() const;
@@ -39,6 +42,8 @@ public:
 
     bool asBool() const;
     double asDouble() const;
+    // the number held, null for any other type
+    const double * number() const;
     std::string asString() const;
 
     void setIndex(int index, Value cellValue);